@@ -67,6 +67,9 @@
 #define USE_AX12_DRIVER
 #define OPT_BACKGROUND_PROCESS    // The AX12 has a background process
 #define OPT_GPPLAYER
+//#define GPSEQ_CACHE_SIZE 256    // Bytes of RAM to cache a whole EEPROM sequence, default 0 - read ahead only
+//#define OPT_AX12_TELEMETRY      // Background reads of servo voltage, temperature and load
+//#define OPT_AX12_HYBRID         // Gait steps as goal+speed keyframes, corrected from the telemetry
 
 #define USE_PYPOSE_HEADER
 
@@ -67,19 +67,143 @@ static const byte GetACos[] PROGMEM = {
   28,27,26,25,24,23,23,23,23,22,22,22,22,21,21,21,21,20,20,20,19,19,19,19,18,18,18,17,17,17,17,16,
   16,16,15,15,15,14,14,13,13,13,12,12,11,11,10,10,9,9,8,7,6,6,5,3,0 };//
 
-//Sin table 90 deg, persision 0.5 deg [180 values]
-static const word GetSin[] PROGMEM = {
-  0, 87, 174, 261, 348, 436, 523, 610, 697, 784, 871, 958, 1045, 1132, 1218, 1305, 1391, 1478, 1564, 
-  1650, 1736, 1822, 1908, 1993, 2079, 2164, 2249, 2334, 2419, 2503, 2588, 2672, 2756, 2840, 2923, 3007, 
-  3090, 3173, 3255, 3338, 3420, 3502, 3583, 3665, 3746, 3826, 3907, 3987, 4067, 4146, 4226, 4305, 4383, 
-  4461, 4539, 4617, 4694, 4771, 4848, 4924, 4999, 5075, 5150, 5224, 5299, 5372, 5446, 5519, 5591, 5664, 
-  5735, 5807, 5877, 5948, 6018, 6087, 6156, 6225, 6293, 6360, 6427, 6494, 6560, 6626, 6691, 6755, 6819, 
-  6883, 6946, 7009, 7071, 7132, 7193, 7253, 7313, 7372, 7431, 7489, 7547, 7604, 7660, 7716, 7771, 7826, 
-  7880, 7933, 7986, 8038, 8090, 8141, 8191, 8241, 8290, 8338, 8386, 8433, 8480, 8526, 8571, 8616, 8660, 
-  8703, 8746, 8788, 8829, 8870, 8910, 8949, 8987, 9025, 9063, 9099, 9135, 9170, 9205, 9238, 9271, 9304, 
-  9335, 9366, 9396, 9426, 9455, 9483, 9510, 9537, 9563, 9588, 9612, 9636, 9659, 9681, 9702, 9723, 9743, 
-  9762, 9781, 9799, 9816, 9832, 9848, 9862, 9876, 9890, 9902, 9914, 9925, 9935, 9945, 9953, 9961, 9969, 
-  9975, 9981, 9986, 9990, 9993, 9996, 9998, 9999, 10000 };//
+//Sin table 90 deg in 128 steps [129 values], decimals = 4
+//Indexed by a binary angle (65536 = 360 deg), see SinCos. Values in between are interpolated.
+static const word GetSinQ[] PROGMEM = {
+  0, 123, 245, 368, 491, 613, 736, 858, 980, 1102, 1224, 1346, 1467, 1589, 1710, 1830,
+  1951, 2071, 2191, 2311, 2430, 2549, 2667, 2785, 2903, 3020, 3137, 3253, 3369, 3484, 3599, 3713,
+  3827, 3940, 4052, 4164, 4276, 4386, 4496, 4605, 4714, 4822, 4929, 5035, 5141, 5246, 5350, 5453,
+  5556, 5657, 5758, 5858, 5957, 6055, 6152, 6249, 6344, 6438, 6532, 6624, 6716, 6806, 6895, 6984,
+  7071, 7157, 7242, 7327, 7410, 7491, 7572, 7652, 7730, 7807, 7883, 7958, 8032, 8105, 8176, 8246,
+  8315, 8382, 8449, 8514, 8577, 8640, 8701, 8761, 8819, 8876, 8932, 8987, 9040, 9092, 9142, 9191,
+  9239, 9285, 9330, 9373, 9415, 9456, 9495, 9533, 9569, 9604, 9638, 9670, 9700, 9729, 9757, 9783,
+  9808, 9831, 9853, 9873, 9892, 9909, 9925, 9939, 9952, 9963, 9973, 9981, 9988, 9993, 9997, 9999,
+  10000 };//
+
+//Result of SinCos, decimals = 4
+typedef struct _SinCos4 {
+  short     sin4;
+  short     cos4;
+} 
+SINCOS4;
+
+//ArcTan table for the CORDIC rotations: atan(2^-i) in radians, decimals = 4
+static const word GetATanCordic[] PROGMEM = {
+  7854, 4636, 2450, 1244, 624, 312, 156, 78, 39, 20, 10, 5, 2, 1 };//
+
+//Result of ATan2Hyp
+typedef struct _ATan2Hyp4 {
+  short     Atan4;        //Angle in radians, decimals = 4
+  long      Hyp2;         //Hypotenuse, decimals = 2
+} 
+ATAN2HYP4;
+
+//Legs 0..CNT_LEGS/2-1 are the right legs, which have their X axis mirrored
+#define cLegsMirrorMask   ((1 << (CNT_LEGS/2)) - 1)
+#define IsLegMirrored(leg) (cLegsMirrorMask & (1 << (leg)))
+
+//IK solution status bits
+#define cIKSolution         0x01    //The solution is possible
+#define cIKSolutionWarning  0x02    //The solution is NEARLY possible
+#define cIKSolutionError    0x04    //The solution is NOT possible
+
+//Per frame body state used by the IK, see BodyFKSetup
+typedef struct _IKBody {
+  short     PosX;           //Body position
+  short     PosY;
+  short     PosZ;
+  short     RotOffsetX;     //Center point of rotation
+  short     RotOffsetY;
+  short     RotOffsetZ;
+  short     RotY1;          //Body rotation Y, decimals = 1
+  short     BalY1;          //Balance rotation Y, decimals = 1
+  short     SinG4;          //Sin/Cos of body rotation X (BodyRotX+TotalXBal1)
+  short     CosG4;
+  short     SinB4;          //Sin/Cos of body rotation Z (BodyRotZ+TotalZBal1)
+  short     CosB4;
+#ifdef OPT_WALK_UPSIDE_DOWN
+  boolean   fUpsideDown;
+#endif
+} 
+IKBODY;
+
+//Input of the IK for all legs. Feet positions are in leg coordinates,
+//so the X axis is mirrored for the right legs
+typedef struct _IKLegsIn {
+  short     FeetPosX[CNT_LEGS];
+  short     FeetPosY[CNT_LEGS];
+  short     FeetPosZ[CNT_LEGS];
+  short     RotY[CNT_LEGS];         //Gait rotation Y in degrees
+} 
+IKLEGSIN;
+
+//Output of the IK for all legs
+typedef struct _IKLegsOut {
+  short     CoxaAngle1[CNT_LEGS];   //Actual Angle of the horizontal hip, decimals = 1
+  short     FemurAngle1[CNT_LEGS];  //Actual Angle of the vertical hip, decimals = 1
+  short     TibiaAngle1[CNT_LEGS];  //Actual Angle of the knee, decimals = 1
+#ifdef c4DOF
+  short     TarsAngle1[CNT_LEGS];   //Actual Angle of the knee, decimals = 1
+#endif
+  byte      bIKStatus;              //cIKSolution* bits of all legs or'ed together
+} 
+IKLEGSOUT;
+
+//Gait phase table, compiled from the current gait by GaitSelect. There is one
+//entry for each LegStep (GaitStep-GaitLegNr), at index LegStep+StepsInGait-1
+#ifndef cMaxGaitSteps
+#define cMaxGaitSteps       32      //Largest StepsInGait the phase table can hold
+#endif
+#define cGaitActMask        0x07    //Action while walking (TravelRequest):
+#define cGaitActMove        0       //  On the ground, move the body forward
+#define cGaitActUp          1       //  Lifted to the middle up position
+#define cGaitActHalfRear    2       //  Half height rear (2, 3, 5 lifted positions)
+#define cGaitActHalfFront   3       //  Half height front (2, 3, 5 lifted positions)
+#define cGaitActHalf5Rear   4       //  Half height rear (5 lifted positions)
+#define cGaitActHalf5Front  5       //  Half height front (5 lifted positions)
+#define cGaitActFrontDown   6       //  Front down position, when the leg is still up
+#define cGaitPhaseUp        0x40    //LegStep==0, lift when standing and not home
+#define cGaitPhaseFrontDown 0x80    //LegStep is the FrontDownPos
+
+//Gait travel per frame, the divisions shared by all the legs, see GaitSeq
+typedef struct _GaitFrame {
+  COORD3D   TravelLift;             //TravelLength/LiftDivFactor
+  COORD3D   TravelHalf;             //TravelLength/2
+  COORD3D   TravelStep;             //TravelLength/TLDivFactor
+  short     HalfLiftY;              //Y of the half height positions
+  short     Half5LiftY;             //Y of the 5 lifted half height positions
+} 
+GAITFRAME;
+
+//Loop timing profiler, see LoopProfile
+#ifdef OPT_LOOP_PROFILER
+#define cProfFrame          0       //Whole loop, start to start
+#define cProfVoltage        1       //CheckVoltage
+#define cProfInput          2       //ControlInput and WriteOutputs
+#define cProfGait           3       //SingleLegControl and GaitSeq
+#define cProfBalance        4       //Balance calculations
+#define cProfIK             5       //BodyFK and LegsIK
+#define cProfCheckAngles    6       //CheckAngles
+#define cProfServoStart     7       //Move time and StartUpdateServos
+#define cProfWait           8       //Waiting for the previous move or the next tick
+#define cProfCommit         9       //CommitServoDriver
+#define cProfCnt            10
+#define cProfBins           12      //Bin 0 <16us, bin n from 8<<n us, the last one is open
+
+typedef struct _LoopProfile {
+  word      wMin;                   //Times in us, saturated to 0xffff
+  word      wMax;
+  word      wCnt;
+  unsigned long lSum;               //Sum of the times of wCnt runs
+  byte      abBins[cProfBins];      //Log2 histogram, halved when a bin overflows
+} 
+LOOPPROFILE;
+#define LoopProfileStart()      LoopProfileFrame()
+#define LoopProfile(bPhase)     LoopProfilePhase(bPhase)
+#else
+#define LoopProfileStart()
+#define LoopProfile(bPhase)
+#endif
 
 
 //Build tables for Leg configuration like I/O and MIN/ Max values to easy access values using a FOR loop
@@ -173,6 +297,30 @@ static const word GetSin[] PROGMEM = {
 #define BALANCE_DELAY 100
 #endif
 
+// Control period of the continuous gait in ms (50Hz)
+#ifdef OPT_GAIT_CONTINUOUS
+#ifndef cGaitTickTime
+#define cGaitTickTime 20
+#endif
+#endif
+
+// Control tick of the fixed rate loop in ms, and the task periods in ticks
+#ifdef OPT_CONTROL_SCHEDULER
+#ifndef cControlTick
+#ifdef OPT_GAIT_CONTINUOUS
+#define cControlTick cGaitTickTime
+#else
+#define cControlTick 20
+#endif
+#endif
+#ifndef cInputTicks
+#define cInputTicks 1
+#endif
+#ifndef cIKTicks
+#define cIKTicks 1
+#endif
+#endif
+
 
 #ifndef QUADMODE
 // Standard Hexapod...
@@ -212,29 +360,6 @@ static const short cTarsHornOffset1[] PROGMEM = {
 #endif
 #endif
 
-//Min / Max values
-#ifndef SERVOS_DO_MINMAX
-const short cCoxaMin1[] PROGMEM = {
-  cRRCoxaMin1,  cRMCoxaMin1,  cRFCoxaMin1,  cLRCoxaMin1,  cLMCoxaMin1,  cLFCoxaMin1};
-const short cCoxaMax1[] PROGMEM = {
-  cRRCoxaMax1,  cRMCoxaMax1,  cRFCoxaMax1,  cLRCoxaMax1,  cLMCoxaMax1,  cLFCoxaMax1};
-const short cFemurMin1[] PROGMEM ={
-  cRRFemurMin1, cRMFemurMin1, cRFFemurMin1, cLRFemurMin1, cLMFemurMin1, cLFFemurMin1};
-const short cFemurMax1[] PROGMEM ={
-  cRRFemurMax1, cRMFemurMax1, cRFFemurMax1, cLRFemurMax1, cLMFemurMax1, cLFFemurMax1};
-const short cTibiaMin1[] PROGMEM ={
-  cRRTibiaMin1, cRMTibiaMin1, cRFTibiaMin1, cLRTibiaMin1, cLMTibiaMin1, cLFTibiaMin1};
-const short cTibiaMax1[] PROGMEM = {
-  cRRTibiaMax1, cRMTibiaMax1, cRFTibiaMax1, cLRTibiaMax1, cLMTibiaMax1, cLFTibiaMax1};
-
-#ifdef c4DOF
-const short cTarsMin1[] PROGMEM = {
-  cRRTarsMin1, cRMTarsMin1, cRFTarsMin1, cLRTarsMin1, cLMTarsMin1, cLFTarsMin1};
-const short cTarsMax1[] PROGMEM = {
-  cRRTarsMax1, cRMTarsMax1, cRFTarsMax1, cLRTarsMax1, cLMTarsMax1, cLFTarsMax1};
-#endif
-#endif
-
 // Servo inverse direction
 const bool cCoxaInv[] = {cRRCoxaInv, cRMCoxaInv, cRFCoxaInv, cLRCoxaInv, cLMCoxaInv, cLFCoxaInv};
 bool cFemurInv[] = {cRRFemurInv, cRMFemurInv, cRFFemurInv, cLRFemurInv, cLMFemurInv, cLFFemurInv};
@@ -321,29 +446,6 @@ static const short cTarsHornOffset1[] PROGMEM = {
 #endif
 #endif
 
-//Min / Max values
-#ifndef SERVOS_DO_MINMAX
-const short cCoxaMin1[] PROGMEM = {
-  cRRCoxaMin1,  cRFCoxaMin1,  cLRCoxaMin1,  cLFCoxaMin1};
-const short cCoxaMax1[] PROGMEM = {
-  cRRCoxaMax1,  cRFCoxaMax1,  cLRCoxaMax1,  cLFCoxaMax1};
-const short cFemurMin1[] PROGMEM ={
-  cRRFemurMin1, cRFFemurMin1, cLRFemurMin1, cLFFemurMin1};
-const short cFemurMax1[] PROGMEM ={
-  cRRFemurMax1, cRFFemurMax1, cLRFemurMax1, cLFFemurMax1};
-const short cTibiaMin1[] PROGMEM ={
-  cRRTibiaMin1, cRFTibiaMin1, cLRTibiaMin1, cLFTibiaMin1};
-const short cTibiaMax1[] PROGMEM = {
-  cRRTibiaMax1, cRFTibiaMax1, cLRTibiaMax1, cLFTibiaMax1};
-
-#ifdef c4DOF
-const short cTarsMin1[] PROGMEM = {
-  cRRTarsMin1, cRFTarsMin1, cLRTarsMin1, cLFTarsMin1};
-const short cTarsMax1[] PROGMEM = {
-  cRRTarsMax1, cRFTarsMax1, cLRTarsMax1, cLFTarsMax1};
-#endif
-#endif
-
 // Servo inverse direction
 const bool cCoxaInv[] = {cRRCoxaInv, cRFCoxaInv, cLRCoxaInv, cLFCoxaInv};
 bool cFemurInv[] = {cRRFemurInv, cRFFemurInv, cLRFemurInv, cLFFemurInv};
@@ -395,6 +497,41 @@ const short cInitPosZ[] PROGMEM = {
 
 #endif
 
+//--------------------------------------------------------------------
+//[LEG TRAITS] Compile time per leg configuration. The per leg code in
+//LegsIK and CheckAngles is unrolled over CNT_LEGS with templates, so these
+//end up as constants and the 3DOF legs of a mixed robot drop the tars code.
+template <byte Leg> struct LegDOF;
+#ifdef c4DOF
+#define LEG_DOF(XX) template <> struct LegDOF<c##XX> {enum {f4DOF = (c##XX##TarsLength) != 0}; }
+#else
+#define LEG_DOF(XX) template <> struct LegDOF<c##XX> {enum {f4DOF = 0}; }
+#endif
+#ifndef QUADMODE
+LEG_DOF(RR); LEG_DOF(RM); LEG_DOF(RF); LEG_DOF(LR); LEG_DOF(LM); LEG_DOF(LF);
+#else
+LEG_DOF(RR); LEG_DOF(RF); LEG_DOF(LR); LEG_DOF(LF);
+#endif
+
+//Min / Max values
+#ifndef SERVOS_DO_MINMAX
+template <byte Leg> struct LegLimits;
+#ifdef c4DOF
+#define LEG_LIMITS(XX) template <> struct LegLimits<c##XX> {enum { \
+    CoxaMin1 = c##XX##CoxaMin1, CoxaMax1 = c##XX##CoxaMax1, FemurMin1 = c##XX##FemurMin1, FemurMax1 = c##XX##FemurMax1, \
+    TibiaMin1 = c##XX##TibiaMin1, TibiaMax1 = c##XX##TibiaMax1, TarsMin1 = c##XX##TarsMin1, TarsMax1 = c##XX##TarsMax1}; }
+#else
+#define LEG_LIMITS(XX) template <> struct LegLimits<c##XX> {enum { \
+    CoxaMin1 = c##XX##CoxaMin1, CoxaMax1 = c##XX##CoxaMax1, FemurMin1 = c##XX##FemurMin1, FemurMax1 = c##XX##FemurMax1, \
+    TibiaMin1 = c##XX##TibiaMin1, TibiaMax1 = c##XX##TibiaMax1}; }
+#endif
+#ifndef QUADMODE
+LEG_LIMITS(RR); LEG_LIMITS(RM); LEG_LIMITS(RF); LEG_LIMITS(LR); LEG_LIMITS(LM); LEG_LIMITS(LF);
+#else
+LEG_LIMITS(RR); LEG_LIMITS(RF); LEG_LIMITS(LR); LEG_LIMITS(LF);
+#endif
+#endif
+
 // Define some globals for debug information
 boolean g_fShowDebugPrompt;
 boolean g_fDebugOutput;
@@ -405,12 +542,7 @@ boolean g_fEnableServos = true;
 #define cTravelDeadZone         4    //The deadzone for the analog input from the remote
 //====================================================================
 //[ANGLES]
-short           CoxaAngle1[CNT_LEGS];    //Actual Angle of the horizontal hip, decimals = 1
-short           FemurAngle1[CNT_LEGS];   //Actual Angle of the vertical hip, decimals = 1
-short           TibiaAngle1[CNT_LEGS];   //Actual Angle of the knee, decimals = 1
-#ifdef c4DOF
-short           TarsAngle1[CNT_LEGS];	  //Actual Angle of the knee, decimals = 1
-#endif
+IKLEGSOUT       g_LegsIKOut;             //Actual Angles of all legs, output of LegsIK
 
 //--------------------------------------------------------------------
 //[POSITIONS SINGLE LEG CONTROL]
@@ -434,34 +566,9 @@ boolean         Eyes;    //Eyes output
 byte            Index;                    //Index universal used
 byte            LegIndex;                //Index used for leg Index Number
 
-//GetSinCos / ArcCos
-short           AngleDeg1;        //Input Angle in degrees, decimals = 1
-short           sin4;             //Output Sinus of the given Angle, decimals = 4
-short           cos4;            //Output Cosinus of the given Angle, decimals = 4
-short           AngleRad4;        //Output Angle in radials, decimals = 4
-
-//GetAtan2
-short           AtanX;            //Input X
-short           AtanY;            //Input Y
-short           Atan4;            //ArcTan2 output
-long            XYhyp2;            //Output presenting Hypotenuse of X and Y
-
-//Body Inverse Kinematics
-short           PosX;            //Input position of the feet X
-short           PosZ;            //Input position of the feet Z
-short           PosY;            //Input position of the feet Y
-long            BodyFKPosX;        //Output Position X of feet with Rotation
-long            BodyFKPosY;        //Output Position Y of feet with Rotation
-long            BodyFKPosZ;        //Output Position Z of feet with Rotation
-
-
-//Leg Inverse Kinematics
-long            IKFeetPosX;        //Input position of the Feet X
-long            IKFeetPosY;        //Input position of the Feet Y
-long            IKFeetPosZ;        //Input Position of the Feet Z
-boolean         IKSolution;        //Output true if the solution is possible
-boolean         IKSolutionWarning;    //Output true if the solution is NEARLY possible
-boolean         IKSolutionError;    //Output true if the solution is NOT possible
+//Inverse Kinematics
+IKBODY          g_IKBody;          //Body rotation and position for this frame
+IKLEGSIN        g_LegsIKIn;        //Feet positions for all legs
 //--------------------------------------------------------------------
 //[TIMING]
 unsigned long   lTimerStart;    //Start time of the calculation cycles
@@ -471,6 +578,22 @@ byte            CycleTime;        //Total Cycle time
 word            ServoMoveTime;        //Time for servo updates
 word            PrevServoMoveTime;    //Previous time for the servo updates
 
+#ifdef OPT_LOOP_PROFILER
+LOOPPROFILE     g_aLoopProfile[cProfCnt];  //Timing of the phases of the loop
+unsigned long   g_lProfTime;          //micros() of the end of the last phase
+unsigned long   g_lProfFrameTime;     //micros() of the start of the loop
+#endif
+
+#ifdef OPT_CONTROL_SCHEDULER
+unsigned long   g_lTickDeadline;      //End of the current control tick
+unsigned long   g_lGaitDeadline;      //End of the move of the current gait step
+word            g_wControlTick;       //Tick counter for the task periods
+IKLEGSOUT       g_LegsIKOutPrev;      //IK result of the last servo update
+long            g_lTickSlack;         //Time left of the last tick in ms, negative when it overran
+long            g_lTickSlackMin;      //Smallest slack since startup
+word            g_wTickOverruns;      //Number of ticks that overran
+#endif
+
 //--------------------------------------------------------------------
 //[GLOABAL]
 //--------------------------------------------------------------------
@@ -502,6 +625,21 @@ boolean         AllDown;
 //[gait - State]
 // Note: Information about the current gait is now part of the g_InControlState...
 boolean         TravelRequest;          //Temp to check if the gait is in motion
+byte            g_abGaitPhase[2*cMaxGaitSteps-1]; //Compiled gait phase table, see GaitSelect
+GAITFRAME       g_GaitFrame;            //Gait travel of the current frame
+#ifdef OPT_GAIT_CONTINUOUS
+word            g_wGaitPhase;           //Phase of the gait cycle, 0x10000 is one full cycle
+word            g_wGaitSwing;           //Part of the cycle a leg is lifted, see GaitCompilePhases
+word            g_awGaitLegPhase[CNT_LEGS]; //Phase at which each leg is in its middle up position
+word            g_awGaitSwingStart[CNT_LEGS]; //Swing phase at which the leg was lifted
+byte            g_bGaitLegsInAir;       //Bit per leg that is in its swing
+boolean         g_fGaitPhaseRun;        //The phase runs while walking or until all legs are home
+unsigned long   g_lGaitPhaseTime;       //millis() of the last phase update
+COORD3D         g_GaitStanceRem;        //Remainder of the stance travel, keeps the legs in sync
+short           GaitSwingX[CNT_LEGS];   //Gait position at the start of the swing
+short           GaitSwingZ[CNT_LEGS];
+short           GaitSwingRotY[CNT_LEGS];
+#endif
 
 long            GaitPosX[CNT_LEGS];         //Array containing Relative X position corresponding to the Gait
 long            GaitPosY[CNT_LEGS];         //Array containing Relative Y position corresponding to the Gait
@@ -552,6 +690,7 @@ PHOENIXGAIT APG[] = {
     {DEFAULT_SLOW_GAIT, 24, 3, 2, 2, 20, 3, {13, 17, 21, 1, 5, 9} GAITNAME(s_szGN5)},     //Wave 24 steps
     {DEFAULT_GAIT_SPEED, 6, 2, 1, 2, 4, 1, {1, 4, 1, 4, 1, 4} GAITNAME(s_szGN6)}          //Tripod 6 steps
 };    
+#define cAPGMaxSteps  24    //Longest gait above, Wave 24
 
 #else
 #ifdef DISPLAY_GAIT_NAMES
@@ -565,6 +704,7 @@ PHOENIXGAIT APG[] = {
     {DEFAULT_GAIT_SPEED, 16, 3, 2, 2, 12, 3, 2250, 3600/16, 30, true, {5, 9, 1, 13} GAITNAME(s_szGN1)},            // Wave 16
     {1, 28, 3, 2, 2, 24, 3, 2250, 3600/28, 30, true, {8, 15, 1, 22} GAITNAME(s_szGN2)}                             // Wave 28?
 };    
+#define cAPGMaxSteps  28    //Longest gait above, Wave 28
 
 #endif
 #endif
@@ -575,16 +715,35 @@ byte NUM_GAITS = sizeof(APG)/sizeof(APG[0]) + sizeof(APG_EXTRA)/sizeof(APG_EXTRA
 #else
 byte NUM_GAITS = sizeof(APG)/sizeof(APG[0]);
 #endif
+#if defined(cAPGMaxSteps) && (cMaxGaitSteps < cAPGMaxSteps)
+#error cMaxGaitSteps is smaller than the longest built in gait
+#endif
+byte g_bGaitTypeCur;    //GaitType of gaitCur, GaitSelect goes back to it if the new gait does not fit
 
 
 
 //=============================================================================
 // Function prototypes
 //=============================================================================
+#ifdef OPT_LOOP_PROFILER
+extern void LoopProfilePhase(byte bPhase);
+extern void LoopProfileFrame(void);
+extern void LoopProfileDump(void);
+extern void LoopProfileReset(void);
+#endif
+extern void InputTask(void);
+extern void GaitTask(void);
+extern void IKTask(void);
+extern boolean ServoMoveTask(void);
+extern void RobotOffTask(void);
 extern void GaitSelect(void);
+extern void GaitCompilePhases(void);
 extern void  WriteOutputs(void);    
 extern void SingleLegControl(void);
 extern void GaitSeq(void);
+#ifdef OPT_GAIT_CONTINUOUS
+extern void GaitContinuous(void);
+#endif
 extern void BalanceBody(void);
 extern void CheckAngles();
 
@@ -593,11 +752,14 @@ extern void    PrintSystemStuff(void);            // Try to see why we fault...
 
 //extern void  GaitGetNextLeg(byte GaitStep);
 extern void BalCalcOneLeg (long PosX, long PosZ, long PosY, byte BalLegNr);
-extern void BodyFK (short PosX, short PosZ, short PosY, short RotationY, byte BodyIKLeg) ;
-extern void LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegNr);
+extern void BodyFKSetup(IKBODY *pBody);
+extern COORD3D BodyFK (short PosX, short PosZ, short PosY, short RotationY, byte BodyIKLeg, const IKBODY *pBody);
+template <bool f4DOF> byte LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegNr, const IKBODY *pBody, IKLEGSOUT *pOut);
+extern void LegsIK (const IKLEGSIN *pIn, const IKBODY *pBody, IKLEGSOUT *pOut);
 extern void Gait (byte GaitCurrentLegNr);
-extern void GetSinCos(short AngleDeg1);
-extern short GetATan2 (short AtanX, short AtanY);
+extern word AngleDeg1ToBin(short AngleDeg1);
+extern SINCOS4 SinCos(word wAngle);
+extern ATAN2HYP4 ATan2Hyp (short AtanX, short AtanY);
 extern unsigned long isqrt32 (unsigned long n);
 
 extern void StartUpdateServos(void);
@@ -691,6 +853,13 @@ void setup(){
   DBGSerial.println(IsRobotUpsideDown, DEC);
 #endif  
 #endif
+#ifdef OPT_CONTROL_SCHEDULER
+  g_lTickDeadline = millis();
+  g_lTickSlackMin = cControlTick;
+#endif
+#ifdef OPT_LOOP_PROFILER
+  LoopProfileReset();
+#endif
 
 }
 
@@ -700,20 +869,238 @@ void setup(){
 //=============================================================================
 
 
+#ifdef OPT_CONTROL_SCHEDULER
+//--------------------------------------------------------------------
+// Fixed rate control loop. Every cControlTick ms the input is read and the
+// IK is redone, so changes of the body position and rotation get to the
+// servos within a tick however slow the gait is. The gait only advances
+// when the move of the previous gait step ends. In between, a changed IK
+// result is sent with the time left of that move, so it still ends with the
+// gait step. The time left of each tick is used for the background processes
+// and recorded in g_lTickSlack.
+//--------------------------------------------------------------------
+void loop(void)
+{
+  long  lSlack;
+  long  lRemain;
+
+  //Wait for the start of the next tick
+  lSlack = (long)(g_lTickDeadline - millis());
+  g_lTickSlack = lSlack;
+  if (lSlack < g_lTickSlackMin)
+    g_lTickSlackMin = lSlack;
+  if (lSlack < 0)
+    g_wTickOverruns++;
+  DebugWrite(A1, HIGH);
+  while ((long)(millis() - g_lTickDeadline) < 0)
+    DoBackgroundProcess();
+  DebugWrite(A1, LOW);
+  LoopProfile(cProfWait);
+  LoopProfileStart();
+  if (lSlack < -cControlTick)
+    g_lTickDeadline = millis();   // More than a tick late, don't try to catch up
+  g_lTickDeadline += cControlTick;
+  g_wControlTick++;
+
+  lTimerStart = millis(); 
+  DoBackgroundProcess();
+  //Read input
+  if (!(g_wControlTick % cInputTicks))
+    InputTask();
+
+#ifdef OPT_GPPLAYER
+    //GP Player
+  g_ServoDriver.GPPlayer();
+  if (g_ServoDriver.FIsGPSeqActive())
+    return;  // go back to process the next message
+#endif
+
+  //Drive Servos
+  if (g_InControlState.fRobotOn) {
+    lRemain = (long)(g_lGaitDeadline - lTimerStart);
+    if (lRemain < cControlTick) {
+      //The move of the previous gait step ends before the next tick, start the next one
+      //so it continues where the previous one ends
+      if (lRemain < 0)
+        lRemain = 0;
+      GaitTask();
+      IKTask();
+      if (ServoMoveTask())
+        g_lGaitDeadline = lTimerStart + lRemain + ServoMoveTime;
+      else {
+        g_lGaitDeadline = lTimerStart;    // Not walking, the next gait step is due next tick
+        lRemain = 0;
+        if (!memcmp(&g_LegsIKOut, &g_LegsIKOutPrev, sizeof(g_LegsIKOut)))
+          lRemain = -1;                   // Nothing changed, skip the servo update
+      }
+      if (lRemain >= 0) {
+        g_LegsIKOutPrev = g_LegsIKOut;
+        DoBackgroundProcess();
+        StartUpdateServos();
+        LoopProfile(cProfServoStart);
+        DebugToggle(A2);
+        g_ServoDriver.CommitServoDriver(ServoMoveTime + lRemain);
+        LoopProfile(cProfCommit);
+      }
+    }
+    else if (!(g_wControlTick % cIKTicks)) {
+      //Between gait steps, redo the IK for the new input and end the move with the gait step
+      IKTask();
+      if (memcmp(&g_LegsIKOut, &g_LegsIKOutPrev, sizeof(g_LegsIKOut))) {
+        g_LegsIKOutPrev = g_LegsIKOut;
+        DoBackgroundProcess();
+        StartUpdateServos();
+        LoopProfile(cProfServoStart);
+        DebugToggle(A2);
+        g_ServoDriver.CommitServoDriver(lRemain);
+        LoopProfile(cProfCommit);
+      }
+    }
+  } 
+  else {
+    RobotOffTask();
+    g_lGaitDeadline = lTimerStart;        // Start with a gait step when turned on
+    g_LegsIKOutPrev.bIKStatus = 0xff;     // and always update the servos
+
+    // We also have a simple debug monitor that allows us to 
+    // check things. call it here..
+#ifdef OPT_TERMINAL_MONITOR  
+    if (TerminalMonitor())
+      return;           
+#endif
+  }
+
+  PrevServoMoveTime = ServoMoveTime;
+
+  //Store previous g_InControlState.fRobotOn State
+  if (g_InControlState.fRobotOn)
+    g_InControlState.fPrev_RobotOn = 1;
+  else
+    g_InControlState.fPrev_RobotOn = 0;
+}
+#else
 void loop(void)
 {
   //Start time
   unsigned long lTimeWaitEnd;
   lTimerStart = millis(); 
+  LoopProfileStart();
   DoBackgroundProcess();
+  //Read input
+  InputTask();
+
+#ifdef OPT_GPPLAYER
+    //GP Player
+  g_ServoDriver.GPPlayer();
+  if (g_ServoDriver.FIsGPSeqActive())
+    return;  // go back to process the next message
+#endif
+
+  //Single leg control and gait
+  GaitTask();
+
+  //Balance and IK
+  IKTask();
+
+  //Drive Servos
+  if (g_InControlState.fRobotOn) {
+    //Calculate Servo Move time
+    boolean fSync = ServoMoveTask();
+
+    // note we broke up the servo driver into start/commit that way we can output all of the servo information
+    // before we wait and only have the termination information to output after the wait.  That way we hopefully
+    // be more accurate with our timings...
+    DoBackgroundProcess();
+    StartUpdateServos();
+    LoopProfile(cProfServoStart);
+
+    // See if we need to sync our processor with the servo driver while walking to ensure the prev is completed 
+    //before sending the next one
+    if (fSync){ 
+      //Get endtime and calculate wait time
+      lTimeWaitEnd = lTimerStart + PrevServoMoveTime;
+
+      DebugWrite(A1, HIGH);
+      do {
+        // Wait the appropriate time, call any background process while waiting...
+        DoBackgroundProcess();
+      } 
+      while (millis() < lTimeWaitEnd);
+      DebugWrite(A1, LOW);
+      LoopProfile(cProfWait);
+#ifdef DEBUG_X
+      if (g_fDebugOutput) {
+
+        DBGSerial.print("BRX:");
+        DBGSerial.print(g_InControlState.BodyRot1.x,DEC); 
+        DBGSerial.print("W?:");
+         DBGSerial.print(fWalking,DEC);  
+         DBGSerial.print(" GS:");
+         DBGSerial.print(g_InControlState.GaitStep,DEC);  
+         //Debug LF leg
+         DBGSerial.print(" GPZ:");
+         DBGSerial.print(GaitPosZ[cLF],DEC);
+         DBGSerial.print(" GPY:");
+         DBGSerial.println(GaitPosY[cLF],DEC);
+      }
+#endif
+    }
+#ifdef DEBUG_X
+    if (g_fDebugOutput) {
+
+
+      DBGSerial.print("TY:");
+      DBGSerial.print(TotalYBal1,DEC); 
+      DBGSerial.print(" LFZ:");
+      DBGSerial.println(LegPosZ[cLF],DEC);
+      DBGSerial.flush();  // see if forcing it to output helps...
+    }
+#endif
+    // Only do commit if we are actually doing something...
+    DebugToggle(A2);
+    g_ServoDriver.CommitServoDriver(ServoMoveTime);
+    LoopProfile(cProfCommit);
+
+
+  } 
+  else {
+    RobotOffTask();
+
+    // We also have a simple debug monitor that allows us to 
+    // check things. call it here..
+#ifdef OPT_TERMINAL_MONITOR  
+    if (TerminalMonitor())
+      return;           
+#endif
+    delay(20);  // give a pause between times we call if nothing is happening
+    LoopProfile(cProfWait);
+  }
+
+  PrevServoMoveTime = ServoMoveTime;
+
+  //Store previous g_InControlState.fRobotOn State
+  if (g_InControlState.fRobotOn)
+    g_InControlState.fPrev_RobotOn = 1;
+  else
+    g_InControlState.fPrev_RobotOn = 0;
+}
+#endif
+
+//--------------------------------------------------------------------
+//[InputTask] Check the voltage and read the input controller
+//--------------------------------------------------------------------
+void InputTask(void)
+{
   //Read input
   CheckVoltage();        // check our voltages...
+  LoopProfile(cProfVoltage);
   if (!g_fLowVoltageShutdown) {
     //    DebugWrite(A0, HIGH);
     g_InputController.ControlInput();
     //    DebugWrite(A0, LOW);
   }
   WriteOutputs();        // Write Outputs
+  LoopProfile(cProfInput);
 
 #ifdef IsRobotUpsideDown
     if (!fWalking){// dont do this while walking
@@ -732,30 +1119,42 @@ void loop(void)
   //  DBGSerial.println(analogRead(0), DEC);
 #endif
 #ifdef OPT_WALK_UPSIDE_DOWN
-  if (g_fRobotUpsideDown){
+  //The body position, rotation and single leg are mirrored where they are used,
+  //GaitTask and IKTask, so a task that runs on its own can not leave them flipped
+  if (g_fRobotUpsideDown)
     g_InControlState.TravelLength.x = -g_InControlState.TravelLength.x;
-    g_InControlState.BodyPos.x = -g_InControlState.BodyPos.x;
-    g_InControlState.SLLeg.x = -g_InControlState.SLLeg.x;
-    g_InControlState.BodyRot1.z = -g_InControlState.BodyRot1.z;
-  }
-#endif
-
-#ifdef OPT_GPPLAYER
-    //GP Player
-  g_ServoDriver.GPPlayer();
-  if (g_ServoDriver.FIsGPSeqActive())
-    return;  // go back to process the next message
 #endif
+}
 
+//--------------------------------------------------------------------
+//[GaitTask] Single leg control and the next gait step
+//--------------------------------------------------------------------
+void GaitTask(void)
+{
   //Single leg control
+#ifdef OPT_WALK_UPSIDE_DOWN
+  if (g_fRobotUpsideDown)
+    g_InControlState.SLLeg.x = -g_InControlState.SLLeg.x;
+#endif
   SingleLegControl ();
+#ifdef OPT_WALK_UPSIDE_DOWN
+  if (g_fRobotUpsideDown) //Set it back for the next input
+    g_InControlState.SLLeg.x = -g_InControlState.SLLeg.x;
+#endif
   DoBackgroundProcess();
 
   //Gait
   GaitSeq();
 
   DoBackgroundProcess();
+  LoopProfile(cProfGait);
+}
 
+//--------------------------------------------------------------------
+//[IKTask] Balance and IK for all legs, from the current gait positions
+//--------------------------------------------------------------------
+void IKTask(void)
+{
   //Balance calculations
   TotalTransX = 0;     //reset values used for calculation of balance
   TotalTransZ = 0;
@@ -795,14 +1194,28 @@ void loop(void)
     }
     BalanceBody();
   }
+  LoopProfile(cProfBalance);
 
+#ifdef OPT_WALK_UPSIDE_DOWN
+  if (g_fRobotUpsideDown){
+    g_InControlState.BodyPos.x = -g_InControlState.BodyPos.x;
+    g_InControlState.BodyRot1.z = -g_InControlState.BodyRot1.z;
+  }
+#endif
+  //Body rotation X and Z are the same for all legs, only calculate them once per frame
+  BodyFKSetup(&g_IKBody);
 
-  //Reset IKsolution indicators 
-  IKSolution = 0 ;
-  IKSolutionWarning = 0; 
-  IKSolutionError = 0 ;
+  //Feet positions in leg coordinates
+  for (LegIndex = 0; LegIndex < CNT_LEGS; LegIndex++) {
+    if (IsLegMirrored(LegIndex))
+      g_LegsIKIn.FeetPosX[LegIndex] = LegPosX[LegIndex] - (GaitPosX[LegIndex] - TotalTransX);
+    else
+      g_LegsIKIn.FeetPosX[LegIndex] = LegPosX[LegIndex] + (GaitPosX[LegIndex] - TotalTransX);
+    g_LegsIKIn.FeetPosY[LegIndex] = LegPosY[LegIndex] + GaitPosY[LegIndex] - TotalTransY;
+    g_LegsIKIn.FeetPosZ[LegIndex] = LegPosZ[LegIndex] + GaitPosZ[LegIndex] - TotalTransZ;
+    g_LegsIKIn.RotY[LegIndex] = GaitRotY[LegIndex];
+  }
 
-  //Do IK for all Right legs
 #ifdef DEBUG
     if (g_fDebugOutput && g_InControlState.fRobotOn) {
         DBGSerial.print(g_InControlState.GaitStep,DEC);
@@ -810,178 +1223,234 @@ void loop(void)
     }
 #endif
 
-  for (LegIndex = 0; LegIndex < (CNT_LEGS/2); LegIndex++) {    
-    DoBackgroundProcess();
-    BodyFK(-LegPosX[LegIndex]+g_InControlState.BodyPos.x+GaitPosX[LegIndex] - TotalTransX,
-    LegPosZ[LegIndex]+g_InControlState.BodyPos.z+GaitPosZ[LegIndex] - TotalTransZ,
-    LegPosY[LegIndex]+g_InControlState.BodyPos.y+GaitPosY[LegIndex] - TotalTransY,
-    GaitRotY[LegIndex], LegIndex);
-
-    LegIK (LegPosX[LegIndex]-g_InControlState.BodyPos.x+BodyFKPosX-(GaitPosX[LegIndex] - TotalTransX), 
-    LegPosY[LegIndex]+g_InControlState.BodyPos.y-BodyFKPosY+GaitPosY[LegIndex] - TotalTransY,
-    LegPosZ[LegIndex]+g_InControlState.BodyPos.z-BodyFKPosZ+GaitPosZ[LegIndex] - TotalTransZ, LegIndex);
-  }
+  //Do IK for all legs. LegsIK only works on its in/out structs, the background
+  //processes run before and after it
+  DoBackgroundProcess();
+  LegsIK(&g_LegsIKIn, &g_IKBody, &g_LegsIKOut);
+  DoBackgroundProcess();
+  LoopProfile(cProfIK);
 
-  //Do IK for all Left legs  
-  for (LegIndex = (CNT_LEGS/2); LegIndex < CNT_LEGS; LegIndex++) {
-    DoBackgroundProcess();
-    BodyFK(LegPosX[LegIndex]-g_InControlState.BodyPos.x+GaitPosX[LegIndex] - TotalTransX,
-    LegPosZ[LegIndex]+g_InControlState.BodyPos.z+GaitPosZ[LegIndex] - TotalTransZ,
-    LegPosY[LegIndex]+g_InControlState.BodyPos.y+GaitPosY[LegIndex] - TotalTransY,
-    GaitRotY[LegIndex], LegIndex);
-    LegIK (LegPosX[LegIndex]+g_InControlState.BodyPos.x-BodyFKPosX+GaitPosX[LegIndex] - TotalTransX,
-    LegPosY[LegIndex]+g_InControlState.BodyPos.y-BodyFKPosY+GaitPosY[LegIndex] - TotalTransY,
-    LegPosZ[LegIndex]+g_InControlState.BodyPos.z-BodyFKPosZ+GaitPosZ[LegIndex] - TotalTransZ, LegIndex);
-  }
 #ifdef OPT_WALK_UPSIDE_DOWN
   if (g_fRobotUpsideDown){ //Need to set them back for not messing with the SmoothControl
     g_InControlState.BodyPos.x = -g_InControlState.BodyPos.x;
-    g_InControlState.SLLeg.x = -g_InControlState.SLLeg.x;
     g_InControlState.BodyRot1.z = -g_InControlState.BodyRot1.z;
   }
 #endif
   //Check mechanical limits
   CheckAngles();
+  LoopProfile(cProfCheckAngles);
 
   //Write IK errors to leds
-  LedC = IKSolutionWarning;
-  LedA = IKSolutionError;
-
-  //Drive Servos
-  if (g_InControlState.fRobotOn) {
-    if (g_InControlState.fRobotOn && !g_InControlState.fPrev_RobotOn) {
-      MSound(3, 60, 2000, 80, 2250, 100, 2500);
-#ifdef USEXBEE
-      XBeePlaySounds(3, 60, 2000, 80, 2250, 100, 2500);
-#endif            
-
-      Eyes = 1;
-    }
-
-    //Calculate Servo Move time
-    if ((abs(g_InControlState.TravelLength.x)>cTravelDeadZone) || (abs(g_InControlState.TravelLength.z)>cTravelDeadZone) ||
-      (abs(g_InControlState.TravelLength.y*2)>cTravelDeadZone)) {         
-      ServoMoveTime = g_InControlState.gaitCur.NomGaitSpeed + (g_InControlState.InputTimeDelay*2) + g_InControlState.SpeedControl;
-
-      //Add aditional delay when Balance mode is on
-      if (g_InControlState.BalanceMode)
-        ServoMoveTime = ServoMoveTime + BALANCE_DELAY;
-    } 
-    else //Movement speed excl. Walking
-    ServoMoveTime = 200 + g_InControlState.SpeedControl;
-
-    // note we broke up the servo driver into start/commit that way we can output all of the servo information
-    // before we wait and only have the termination information to output after the wait.  That way we hopefully
-    // be more accurate with our timings...
-    DoBackgroundProcess();
-    StartUpdateServos();
-
-    // See if we need to sync our processor with the servo driver while walking to ensure the prev is completed 
-    //before sending the next one
-
-
-    // Finding any incident of GaitPos/Rot <>0:
-    for (LegIndex = 0; LegIndex < CNT_LEGS; LegIndex++) {
-      if ( (GaitPosX[LegIndex] > cGPlimit) || (GaitPosX[LegIndex] < -cGPlimit)
-        || (GaitPosZ[LegIndex] > cGPlimit) || (GaitPosZ[LegIndex] < -cGPlimit) 
-        || (GaitRotY[LegIndex] > cGPlimit) || (GaitRotY[LegIndex] < -cGPlimit))    {
-
-        bExtraCycle = g_InControlState.gaitCur.NrLiftedPos + 1;//For making sure that we are using timed move until all legs are down
-        break;
-      }
-    }
-    if (bExtraCycle>0){ 
-      bExtraCycle--;
-      fWalking = !(bExtraCycle==0);
-
-      //Get endtime and calculate wait time
-      lTimeWaitEnd = lTimerStart + PrevServoMoveTime;
+  LedC = (g_LegsIKOut.bIKStatus & cIKSolutionWarning) != 0;
+  LedA = (g_LegsIKOut.bIKStatus & cIKSolutionError) != 0;
+}
 
-      DebugWrite(A1, HIGH);
-      do {
-        // Wait the appropriate time, call any background process while waiting...
-        DoBackgroundProcess();
-      } 
-      while (millis() < lTimeWaitEnd);
-      DebugWrite(A1, LOW);
-#ifdef DEBUG_X
-      if (g_fDebugOutput) {
+//--------------------------------------------------------------------
+//[ServoMoveTask] Calculates ServoMoveTime for the next servo update.
+//Returns true while walking, when this move has to follow the previous one
+//instead of replacing it.
+//--------------------------------------------------------------------
+boolean ServoMoveTask(void)
+{
+  if (g_InControlState.fRobotOn && !g_InControlState.fPrev_RobotOn) {
+    MSound(3, 60, 2000, 80, 2250, 100, 2500);
+#ifdef USEXBEE
+    XBeePlaySounds(3, 60, 2000, 80, 2250, 100, 2500);
+#endif            
 
-        DBGSerial.print("BRX:");
-        DBGSerial.print(g_InControlState.BodyRot1.x,DEC); 
-        DBGSerial.print("W?:");
-         DBGSerial.print(fWalking,DEC);  
-         DBGSerial.print(" GS:");
-         DBGSerial.print(g_InControlState.GaitStep,DEC);  
-         //Debug LF leg
-         DBGSerial.print(" GPZ:");
-         DBGSerial.print(GaitPosZ[cLF],DEC);
-         DBGSerial.print(" GPY:");
-         DBGSerial.println(GaitPosY[cLF],DEC);
-      }
+    Eyes = 1;
+  }
+
+  //Calculate Servo Move time
+#ifdef OPT_GAIT_CONTINUOUS
+  //The continuous gait runs at a fixed control rate
+  if (g_fGaitPhaseRun)
+    ServoMoveTime = cGaitTickTime;
+  else
 #endif
-    }
-#ifdef DEBUG_X
-    if (g_fDebugOutput) {
+  if ((abs(g_InControlState.TravelLength.x)>cTravelDeadZone) || (abs(g_InControlState.TravelLength.z)>cTravelDeadZone) ||
+    (abs(g_InControlState.TravelLength.y*2)>cTravelDeadZone)) {         
+    ServoMoveTime = g_InControlState.gaitCur.NomGaitSpeed + (g_InControlState.InputTimeDelay*2) + g_InControlState.SpeedControl;
+
+    //Add aditional delay when Balance mode is on
+    if (g_InControlState.BalanceMode)
+      ServoMoveTime = ServoMoveTime + BALANCE_DELAY;
+  } 
+  else //Movement speed excl. Walking
+  ServoMoveTime = 200 + g_InControlState.SpeedControl;
 
+  // Finding any incident of GaitPos/Rot <>0:
+  for (LegIndex = 0; LegIndex < CNT_LEGS; LegIndex++) {
+    if ( (GaitPosX[LegIndex] > cGPlimit) || (GaitPosX[LegIndex] < -cGPlimit)
+      || (GaitPosZ[LegIndex] > cGPlimit) || (GaitPosZ[LegIndex] < -cGPlimit) 
+      || (GaitRotY[LegIndex] > cGPlimit) || (GaitRotY[LegIndex] < -cGPlimit))    {
 
-      DBGSerial.print("TY:");
-      DBGSerial.print(TotalYBal1,DEC); 
-      DBGSerial.print(" LFZ:");
-      DBGSerial.println(LegPosZ[cLF],DEC);
-      DBGSerial.flush();  // see if forcing it to output helps...
+      bExtraCycle = g_InControlState.gaitCur.NrLiftedPos + 1;//For making sure that we are using timed move until all legs are down
+      break;
     }
+  }
+#ifdef OPT_GAIT_CONTINUOUS
+  if (g_fGaitPhaseRun && (bExtraCycle == 0))
+    bExtraCycle = 1;    //Keep the timed moves until all legs are home
 #endif
-    // Only do commit if we are actually doing something...
-    DebugToggle(A2);
-    g_ServoDriver.CommitServoDriver(ServoMoveTime);
+  if (bExtraCycle>0){ 
+    bExtraCycle--;
+    fWalking = !(bExtraCycle==0);
+    return true;
+  }
+  return false;
+}
 
+//--------------------------------------------------------------------
+//[RobotOffTask] Turns the robot off or frees the servos when it is off
+//--------------------------------------------------------------------
+void RobotOffTask(void)
+{
+  unsigned long lTimeWaitEnd;
 
-  } 
-  else {
-    //Turn the bot off - May need to add ajust here...
-    if (g_InControlState.fPrev_RobotOn || (AllDown= 0)) {
-      ServoMoveTime = 600;
-      StartUpdateServos();
-      g_ServoDriver.CommitServoDriver(ServoMoveTime);
-      MSound(3, 100, 2500, 80, 2250, 60, 2000);
+  //Turn the bot off - May need to add ajust here...
+  if (g_InControlState.fPrev_RobotOn || (AllDown= 0)) {
+    ServoMoveTime = 600;
+    StartUpdateServos();
+    g_ServoDriver.CommitServoDriver(ServoMoveTime);
+    MSound(3, 100, 2500, 80, 2250, 60, 2000);
 #ifdef USEXBEE            
-      XBeePlaySounds(3, 100, 2500, 80, 2250, 60, 2000);
+    XBeePlaySounds(3, 100, 2500, 80, 2250, 60, 2000);
 #endif    
-      lTimeWaitEnd = millis() + 600;    // setup to process background stuff while we wait...
-      do {
-        // Wait the appropriate time, call any background process while waiting...
-        DoBackgroundProcess();
-      } 
-      while (millis() < lTimeWaitEnd);
-      //delay(600);
+    lTimeWaitEnd = millis() + 600;    // setup to process background stuff while we wait...
+    do {
+      // Wait the appropriate time, call any background process while waiting...
+      DoBackgroundProcess();
     } 
-    else {
-      g_ServoDriver.FreeServos();
-      Eyes = 0;
-    }
+    while (millis() < lTimeWaitEnd);
+    //delay(600);
+  } 
+  else {
+    g_ServoDriver.FreeServos();
+    Eyes = 0;
+  }
 
-    // Allow the Servo driver to do stuff durint our idle time
-    g_ServoDriver.IdleTime();
+  // Allow the Servo driver to do stuff durint our idle time
+  g_ServoDriver.IdleTime();
+}
 
-    // We also have a simple debug monitor that allows us to 
-    // check things. call it here..
-#ifdef OPT_TERMINAL_MONITOR  
-    if (TerminalMonitor())
-      return;           
-#endif
-    delay(20);  // give a pause between times we call if nothing is happening
+#ifdef OPT_LOOP_PROFILER
+//--------------------------------------------------------------------
+//[LoopProfilePhase] Adds the time since the end of the previous phase to
+//the timing of bPhase. The min, max and mean are in us, the histogram
+//counts the runs per power of 2 of us.
+//--------------------------------------------------------------------
+static void LoopProfileAdd(byte bPhase, unsigned long lTime)
+{
+  LOOPPROFILE *pProf = &g_aLoopProfile[bPhase];
+  word  wTime = (lTime > 0xffff)? 0xffff : lTime;
+  word  w;
+  byte  bBin;
+
+  if (wTime < pProf->wMin)
+    pProf->wMin = wTime;
+  if (wTime > pProf->wMax)
+    pProf->wMax = wTime;
+
+  // Keep the mean, but halve the count and sum before they overflow. The sum
+  // uses the clamped time, so 0xffff runs of at most 0xffff us fit in 32 bits
+  if (pProf->wCnt == 0xffff) {
+    pProf->wCnt >>= 1;
+    pProf->lSum >>= 1;
+  }
+  pProf->wCnt++;
+  pProf->lSum += wTime;
+
+  for (bBin = 0, w = wTime >> 4; w && (bBin < (cProfBins-1)); w >>= 1)
+    bBin++;
+  // Keep the shape of the histogram, but halve it when a bin is full
+  if (pProf->abBins[bBin] == 0xff) {
+    for (w = 0; w < cProfBins; w++)
+      pProf->abBins[w] >>= 1;
   }
+  pProf->abBins[bBin]++;
+}
 
-  PrevServoMoveTime = ServoMoveTime;
+void LoopProfilePhase(byte bPhase)
+{
+  unsigned long lNow = micros();
 
-  //Store previous g_InControlState.fRobotOn State
-  if (g_InControlState.fRobotOn)
-    g_InControlState.fPrev_RobotOn = 1;
-  else
-    g_InControlState.fPrev_RobotOn = 0;
+  LoopProfileAdd(bPhase, lNow - g_lProfTime);
+  g_lProfTime = lNow;
+}
+
+//--------------------------------------------------------------------
+//[LoopProfileFrame] Start of the loop, times the whole previous loop
+//--------------------------------------------------------------------
+void LoopProfileFrame(void)
+{
+  unsigned long lNow = micros();
+
+  if (g_lProfFrameTime)
+    LoopProfileAdd(cProfFrame, lNow - g_lProfFrameTime);
+  g_lProfFrameTime = lNow;
+  g_lProfTime = lNow;
+}
+
+//--------------------------------------------------------------------
+//[LoopProfileReset]
+//--------------------------------------------------------------------
+void LoopProfileReset(void)
+{
+  byte  bPhase;
+
+  memset(g_aLoopProfile, 0, sizeof(g_aLoopProfile));
+  for (bPhase = 0; bPhase < cProfCnt; bPhase++)
+    g_aLoopProfile[bPhase].wMin = 0xffff;
+  g_lProfFrameTime = 0;
 }
 
+#ifdef DBGSerial
+//--------------------------------------------------------------------
+//[LoopProfileDump] One line per phase: name, count, min, mean and max in us,
+//then the histogram bins
+//--------------------------------------------------------------------
+static const char s_szProfNames[] PROGMEM = "FrameVolt InputGait Bal  IK   CheckServoWait Commt";
+
+void LoopProfileDump(void)
+{
+  LOOPPROFILE *pProf;
+  byte  bPhase;
+  byte  b;
+
+  DBGSerial.println(F("Phase Cnt Min Mean Max | <16 <32 <64 ... >=16384us"));
+  for (bPhase = 0; bPhase < cProfCnt; bPhase++) {
+    pProf = &g_aLoopProfile[bPhase];
+    for (b = 0; b < 5; b++)
+      DBGSerial.write(pgm_read_byte(&s_szProfNames[bPhase*5 + b]));
+    DBGSerial.print(" ");
+    DBGSerial.print(pProf->wCnt, DEC);
+    if (pProf->wCnt) {
+      DBGSerial.print(" ");
+      DBGSerial.print(pProf->wMin, DEC);
+      DBGSerial.print(" ");
+      DBGSerial.print(pProf->lSum / pProf->wCnt, DEC);
+      DBGSerial.print(" ");
+      DBGSerial.print(pProf->wMax, DEC);
+      DBGSerial.print(" |");
+      for (b = 0; b < cProfBins; b++) {
+        DBGSerial.print(" ");
+        DBGSerial.print(pProf->abBins[b], DEC);
+      }
+    }
+    DBGSerial.println();
+  }
+#ifdef OPT_CONTROL_SCHEDULER
+  DBGSerial.print(F("Tick slack min "));
+  DBGSerial.print(g_lTickSlackMin, DEC);
+  DBGSerial.print(F(" overruns "));
+  DBGSerial.println(g_wTickOverruns, DEC);
+  g_lTickSlackMin = cControlTick;
+  g_wTickOverruns = 0;
+#endif
+}
+#endif
+#endif
 
 void StartUpdateServos()
 {        
@@ -993,15 +1462,15 @@ void StartUpdateServos()
     for (LegIndex = 0; LegIndex < CNT_LEGS; LegIndex++) {
 #ifdef c4DOF
     g_ServoDriver.OutputServoInfoForLeg(LegIndex, 
-        cCoxaInv[LegIndex]? -CoxaAngle1[LegIndex] : CoxaAngle1[LegIndex], 
-        cFemurInv[LegIndex]? -FemurAngle1[LegIndex] : FemurAngle1[LegIndex], 
-        cTibiaInv[LegIndex]? -TibiaAngle1[LegIndex] : TibiaAngle1[LegIndex], 
-        cTarsInv[LegIndex]? -TarsAngle1[LegIndex] : TarsAngle1[LegIndex]);
+        cCoxaInv[LegIndex]? -g_LegsIKOut.CoxaAngle1[LegIndex] : g_LegsIKOut.CoxaAngle1[LegIndex], 
+        cFemurInv[LegIndex]? -g_LegsIKOut.FemurAngle1[LegIndex] : g_LegsIKOut.FemurAngle1[LegIndex], 
+        cTibiaInv[LegIndex]? -g_LegsIKOut.TibiaAngle1[LegIndex] : g_LegsIKOut.TibiaAngle1[LegIndex], 
+        cTarsInv[LegIndex]? -g_LegsIKOut.TarsAngle1[LegIndex] : g_LegsIKOut.TarsAngle1[LegIndex]);
 #else
     g_ServoDriver.OutputServoInfoForLeg(LegIndex, 
-        cCoxaInv[LegIndex]? -CoxaAngle1[LegIndex] : CoxaAngle1[LegIndex], 
-        cFemurInv[LegIndex]? -FemurAngle1[LegIndex] : FemurAngle1[LegIndex], 
-        cTibiaInv[LegIndex]? -TibiaAngle1[LegIndex] : TibiaAngle1[LegIndex]);
+        cCoxaInv[LegIndex]? -g_LegsIKOut.CoxaAngle1[LegIndex] : g_LegsIKOut.CoxaAngle1[LegIndex], 
+        cFemurInv[LegIndex]? -g_LegsIKOut.FemurAngle1[LegIndex] : g_LegsIKOut.FemurAngle1[LegIndex], 
+        cTibiaInv[LegIndex]? -g_LegsIKOut.TibiaAngle1[LegIndex] : g_LegsIKOut.TibiaAngle1[LegIndex]);
 #endif      
   }
 #ifdef cTurretRotPin
@@ -1137,21 +1606,145 @@ void SingleLegControl(void)
 }
 
 
+//--------------------------------------------------------------------
+//[GaitCompilePhases] Compiles the current gait into g_abGaitPhase, so Gait
+//only has to look up the action of a leg. The gait rules are evaluated once
+//for every LegStep from -(StepsInGait-1) to StepsInGait-1.
+//
+//Lifted positions match both LegStep==k and LegStep==-(StepsInGait-k), except
+//the 5 lifted half height rear, which has only ever matched LegStep==-2.
+//The front down position is checked last, so it is shadowed when one of the
+//lifted positions uses the same LegStep. With NrLiftedPos=3, FrontDownPos=2 a
+//leg goes up (0), half front (1), front down (2). With NrLiftedPos=2,
+//FrontDownPos=1 the half front (1) wins, and the leg is only put down by the
+//next body move.
+//--------------------------------------------------------------------
+void GaitCompilePhases(void)
+{
+  short LegStep;
+  byte  bSteps;
+  byte  bLifted = g_InControlState.gaitCur.NrLiftedPos;
+  short FrontDownPos = g_InControlState.gaitCur.FrontDownPos;
+  byte  bPhase;
+#ifdef DBGSerial
+  byte  bShadowed = 0;
+#endif
+
+  // GaitSelect only takes gaits that fit the table, see GaitFitsPhaseTable
+  bSteps = g_InControlState.gaitCur.StepsInGait;
+
+  for (LegStep = 1-bSteps; LegStep < bSteps; LegStep++) {
+    if ((bLifted & 1) && LegStep == 0)
+      bPhase = cGaitActUp;
+    else if ((bLifted == 2 && LegStep == 0) || (bLifted >= 3 && (LegStep == -1 || LegStep == bSteps-1)))
+      bPhase = cGaitActHalfRear;
+    else if (bLifted >= 2 && (LegStep == 1 || LegStep == 1-bSteps))
+      bPhase = cGaitActHalfFront;
+    else if (bLifted == 5 && LegStep == -2)
+      bPhase = cGaitActHalf5Rear;
+    else if (bLifted == 5 && (LegStep == 2 || LegStep == 2-bSteps))
+      bPhase = cGaitActHalf5Front;
+    else if (LegStep == FrontDownPos || LegStep == FrontDownPos-bSteps)
+      bPhase = cGaitActFrontDown;
+    else
+      bPhase = cGaitActMove;
+
+    if (LegStep == 0)
+      bPhase |= cGaitPhaseUp;
+    if (LegStep == FrontDownPos || LegStep == FrontDownPos-bSteps) {
+      bPhase |= cGaitPhaseFrontDown;
+#ifdef DBGSerial
+      if ((bPhase & cGaitActMask) != cGaitActFrontDown)
+        bShadowed = 1;
+#endif
+    }
+    g_abGaitPhase[LegStep+bSteps-1] = bPhase;
+  }
+
+#ifdef OPT_GAIT_CONTINUOUS
+  // Continuous gait: a leg is lifted for the steps it is not on the floor,
+  // centered on its middle up position (LegStep==0)
+  LegStep = bSteps - g_InControlState.gaitCur.TLDivFactor;
+  if (LegStep < 1)
+    LegStep = 1;
+  else if (LegStep >= bSteps)
+    LegStep = bSteps - 1;
+  g_wGaitSwing = ((unsigned long)LegStep << 16) / bSteps;
+  for (LegStep = 0; LegStep < CNT_LEGS; LegStep++)
+    g_awGaitLegPhase[LegStep] = ((unsigned long)(g_InControlState.gaitCur.GaitLegNr[LegStep] - 1) << 16) / bSteps;
+#endif
+
+#ifdef DBGSerial  
+  if (g_fDebugOutput) {
+    DBGSerial.print("Phases:");
+    for (LegStep = 0; LegStep < 2*bSteps-1; LegStep++) {
+      DBGSerial.print(" ");
+      DBGSerial.print(g_abGaitPhase[LegStep], HEX);
+    }
+    if (bShadowed)
+      DBGSerial.print(" FrontDownPos shadowed");
+    DBGSerial.println();
+  }  
+#endif  
+}
+
+//--------------------------------------------------------------------
+//[GaitFitsPhaseTable] True if the gait fits in g_abGaitPhase: at most
+//cMaxGaitSteps steps and every GaitLegNr within 1..StepsInGait
+//--------------------------------------------------------------------
+boolean GaitFitsPhaseTable(const PHOENIXGAIT *pGait)
+{
+  if (!pGait->StepsInGait || (pGait->StepsInGait > cMaxGaitSteps))
+    return false;
+  for (byte bLeg = 0; bLeg < CNT_LEGS; bLeg++) {
+    if (!pGait->GaitLegNr[bLeg] || (pGait->GaitLegNr[bLeg] > pGait->StepsInGait))
+      return false;
+  }
+  return true;
+}
+
 void GaitSelect(void)
 {
+  const PHOENIXGAIT *pGait;
+#ifdef ADD_GAITS
+  const byte bAPGFirst = sizeof(APG_EXTRA)/sizeof(APG_EXTRA[0]);    //GaitType of APG[0]
+#else
+  const byte bAPGFirst = 0;
+#endif
   //Gait selector
   // First pass simply use defined table, next up will allow robots to add or relace set...
   if (g_InControlState.GaitType < NUM_GAITS) {
 #ifdef ADD_GAITS
-    if (g_InControlState.GaitType < (sizeof(APG_EXTRA)/sizeof(APG_EXTRA[0])))
-        g_InControlState.gaitCur = APG_EXTRA[g_InControlState.GaitType];
+    if (g_InControlState.GaitType < bAPGFirst)
+        pGait = &APG_EXTRA[g_InControlState.GaitType];
     else
-        g_InControlState.gaitCur = APG[g_InControlState.GaitType - (sizeof(APG_EXTRA)/sizeof(APG_EXTRA[0]))];
-#else
-    g_InControlState.gaitCur = APG[g_InControlState.GaitType];
 #endif
+        pGait = &APG[g_InControlState.GaitType - bAPGFirst];
+
+    if (GaitFitsPhaseTable(pGait)) {
+      g_InControlState.gaitCur = *pGait;
+      g_bGaitTypeCur = g_InControlState.GaitType;
+    }
+    else {
+#ifdef DBGSerial
+      DBGSerial.print("Gait ");
+      DBGSerial.print(g_InControlState.GaitType, DEC);
+      DBGSerial.println(" does not fit cMaxGaitSteps, ignored");
+#endif
+      if (!g_InControlState.gaitCur.StepsInGait) {
+        //Nothing selected yet, start with the first built in gait
+        g_InControlState.gaitCur = APG[0];
+        g_bGaitTypeCur = bAPGFirst;
+      }
+      g_InControlState.GaitType = g_bGaitTypeCur;
+      return;
+    }
   }
 
+  //A shorter gait would leave GaitStep past its end, where Gait() reads no phases
+  if (g_InControlState.GaitStep > g_InControlState.gaitCur.StepsInGait)
+    g_InControlState.GaitStep = 1;
+
 #ifdef DBGSerial  
   if (g_fDebugOutput) {
     DBGSerial.print(g_InControlState.GaitType, DEC);
@@ -1179,6 +1772,7 @@ void GaitSelect(void)
   }  
 #endif  
 
+  GaitCompilePhases();
 }    
 
 //--------------------------------------------------------------------
@@ -1213,6 +1807,22 @@ void GaitSeq(void)
     } 
   }
 
+#ifdef OPT_GAIT_CONTINUOUS
+  GaitContinuous();
+#else
+  //Travel of this frame, the same for all legs
+  g_GaitFrame.TravelLift.x = g_InControlState.TravelLength.x/g_InControlState.gaitCur.LiftDivFactor;
+  g_GaitFrame.TravelLift.y = g_InControlState.TravelLength.y/g_InControlState.gaitCur.LiftDivFactor;
+  g_GaitFrame.TravelLift.z = g_InControlState.TravelLength.z/g_InControlState.gaitCur.LiftDivFactor;
+  g_GaitFrame.TravelHalf.x = g_InControlState.TravelLength.x/2;
+  g_GaitFrame.TravelHalf.y = g_InControlState.TravelLength.y/2;
+  g_GaitFrame.TravelHalf.z = g_InControlState.TravelLength.z/2;
+  g_GaitFrame.TravelStep.x = g_InControlState.TravelLength.x/(short)g_InControlState.gaitCur.TLDivFactor;
+  g_GaitFrame.TravelStep.y = g_InControlState.TravelLength.y/(short)g_InControlState.gaitCur.TLDivFactor;
+  g_GaitFrame.TravelStep.z = g_InControlState.TravelLength.z/(short)g_InControlState.gaitCur.TLDivFactor;
+  g_GaitFrame.HalfLiftY = -3*g_InControlState.LegLiftHeight/(3+g_InControlState.gaitCur.HalfLiftHeight);     //Easier to shift between div factor: /1 (3/3), /2 (3/6) and 3/4
+  g_GaitFrame.Half5LiftY = -g_InControlState.LegLiftHeight/2;
+
   //Calculate Gait sequence
   for (LegIndex = 0; LegIndex < CNT_LEGS; LegIndex++) { // for all legs
     Gait(LegIndex);
@@ -1226,77 +1836,221 @@ void GaitSeq(void)
   // If we have a force count decrement it now... 
   if (g_InControlState.ForceGaitStepCnt)
     g_InControlState.ForceGaitStepCnt--;
+#endif
 }
 
 
+#ifdef OPT_GAIT_CONTINUOUS
+//--------------------------------------------------------------------
+//[GaitContinuous] Continuous phase gait. The phase of the gait cycle advances
+//with the time since the previous frame, so the feet follow smooth paths at
+//any control rate instead of one position per gait step.
+// - Stance: all legs on the floor move back by the same part of TravelLength,
+//   the whole TravelLength over the stance.
+// - Swing: cubic Bezier from the lift off position to TravelLength/2 in front,
+//   with the control points on the end points so it starts and stops smoothly.
+//   The lift is a cubic Bezier with both control points at 4/3 LegLiftHeight,
+//   so the foot is LegLiftHeight up halfway.
+//When not walking the phase keeps running until all legs are down at home.
+//Fractions are in 1/0x8000.
+//--------------------------------------------------------------------
+void GaitContinuous(void)
+{
+  byte          bSteps = g_InControlState.gaitCur.StepsInGait;
+  unsigned long lNow = millis();
+  unsigned long lTime;
+  long          lStepTime;
+  long          lStance = 0x10000L - g_wGaitSwing;
+  word          wPhaseDelta;
+  word          wLegPhase;
+  byte          bLegMask;
+  byte          bGaitStep;
+  long          s;                  //Swing fraction
+  long          s2;
+  long          lCurve;             //Horizontal Bezier, 0 at lift off, 0x8000 at touch down
+  long          lLift;              //Vertical Bezier, 0x8000 halfway
+  boolean       fHome = true;
+
+  if (!g_fGaitPhaseRun) {
+    if (!TravelRequest)
+      return;           // All legs are down at home
+    // Start the cycle at the current gait step
+    g_fGaitPhaseRun = true;
+    g_lGaitPhaseTime = lNow;
+    g_wGaitPhase = ((unsigned long)(g_InControlState.GaitStep - 1) << 16) / bSteps;
+    g_GaitStanceRem.x = 0;
+    g_GaitStanceRem.y = 0;
+    g_GaitStanceRem.z = 0;
+  }
+
+  //Advance the phase, one gait step takes the same time as the timed moves of the step gait
+  lStepTime = g_InControlState.gaitCur.NomGaitSpeed + (g_InControlState.InputTimeDelay*2) + g_InControlState.SpeedControl;
+  if (g_InControlState.BalanceMode)
+    lStepTime = lStepTime + BALANCE_DELAY;
+  if (lStepTime < 1)
+    lStepTime = 1;
+  lTime = lNow - g_lGaitPhaseTime;
+  if (lTime > (2*cGaitTickTime))
+    lTime = 2*cGaitTickTime;    //Slow frames slow down the gait instead of jumping
+  lTime = (lTime << 16) / (lStepTime * bSteps);
+  if (lTime > (g_wGaitSwing/2))
+    lTime = g_wGaitSwing/2;    //Never skip the swing of a leg
+  wPhaseDelta = lTime;
+  g_wGaitPhase += wPhaseDelta;
+  g_lGaitPhaseTime = lNow;
+
+  //Travel of this frame, the same for all legs
+  g_GaitFrame.TravelHalf.x = g_InControlState.TravelLength.x/2;
+  g_GaitFrame.TravelHalf.y = g_InControlState.TravelLength.y/2;
+  g_GaitFrame.TravelHalf.z = g_InControlState.TravelLength.z/2;
+  g_GaitStanceRem.x += g_InControlState.TravelLength.x * wPhaseDelta;
+  g_GaitStanceRem.y += g_InControlState.TravelLength.y * wPhaseDelta;
+  g_GaitStanceRem.z += g_InControlState.TravelLength.z * wPhaseDelta;
+  g_GaitFrame.TravelStep.x = g_GaitStanceRem.x / lStance;
+  g_GaitFrame.TravelStep.y = g_GaitStanceRem.y / lStance;
+  g_GaitFrame.TravelStep.z = g_GaitStanceRem.z / lStance;
+  g_GaitStanceRem.x -= g_GaitFrame.TravelStep.x * lStance;
+  g_GaitStanceRem.y -= g_GaitFrame.TravelStep.y * lStance;
+  g_GaitStanceRem.z -= g_GaitFrame.TravelStep.z * lStance;
+
+  for (LegIndex = 0; LegIndex < CNT_LEGS; LegIndex++) {
+    bLegMask = 1 << LegIndex;
+    //Phase since the start of the swing of this leg
+    wLegPhase = g_wGaitPhase - g_awGaitLegPhase[LegIndex] + (g_wGaitSwing/2);
+
+    //Lift off, when walking or when the leg is not home yet
+    if ((wLegPhase < g_wGaitSwing) && !(g_bGaitLegsInAir & bLegMask) && (TravelRequest || 
+      (abs(GaitPosX[LegIndex])>2) || (abs(GaitPosZ[LegIndex])>2) || (abs(GaitRotY[LegIndex])>2))) {
+      g_bGaitLegsInAir |= bLegMask;
+      GaitSwingX[LegIndex] = GaitPosX[LegIndex];
+      GaitSwingZ[LegIndex] = GaitPosZ[LegIndex];
+      GaitSwingRotY[LegIndex] = GaitRotY[LegIndex];
+      g_awGaitSwingStart[LegIndex] = wLegPhase;
+    }
+
+    if (g_bGaitLegsInAir & bLegMask) {
+      if (wLegPhase < g_wGaitSwing) {
+        //Swing, over what is left of it when the leg was lifted late
+        s = ((long)(wLegPhase - g_awGaitSwingStart[LegIndex]) << 15) / (g_wGaitSwing - g_awGaitSwingStart[LegIndex]);
+        s2 = (s*s) >> 15;
+        lCurve = 3*s2 - 2*((s2*s) >> 15);
+        lLift = (4*s*(0x8000L-s)) >> 15;
+        GaitPosX[LegIndex] = GaitSwingX[LegIndex] + (((g_GaitFrame.TravelHalf.x - GaitSwingX[LegIndex]) * lCurve) >> 15);
+        GaitPosY[LegIndex] = -(((long)g_InControlState.LegLiftHeight * lLift) >> 15);
+        GaitPosZ[LegIndex] = GaitSwingZ[LegIndex] + (((g_GaitFrame.TravelHalf.z - GaitSwingZ[LegIndex]) * lCurve) >> 15);
+        GaitRotY[LegIndex] = GaitSwingRotY[LegIndex] + (((g_GaitFrame.TravelHalf.y - GaitSwingRotY[LegIndex]) * lCurve) >> 15);
+        fHome = false;
+        continue;
+      }
+      //Touch down at the front position
+      g_bGaitLegsInAir &= ~bLegMask;
+      GaitPosX[LegIndex] = g_GaitFrame.TravelHalf.x;
+      GaitPosZ[LegIndex] = g_GaitFrame.TravelHalf.z;
+      GaitRotY[LegIndex] = g_GaitFrame.TravelHalf.y;
+    }
+
+    //Stance, move body forward
+    GaitPosX[LegIndex] = GaitPosX[LegIndex] - g_GaitFrame.TravelStep.x;
+    GaitPosY[LegIndex] = 0;
+    GaitPosZ[LegIndex] = GaitPosZ[LegIndex] - g_GaitFrame.TravelStep.z;
+    GaitRotY[LegIndex] = GaitRotY[LegIndex] - g_GaitFrame.TravelStep.y;
+    if ((abs(GaitPosX[LegIndex])>2) || (abs(GaitPosZ[LegIndex])>2) || (abs(GaitRotY[LegIndex])>2))
+      fHome = false;
+  }
+
+  //Stop when not walking and all legs are down at home
+  if (!TravelRequest && fHome)
+    g_fGaitPhaseRun = false;
+
+  //Keep the gait step in sync with the phase
+  bGaitStep = (((unsigned long)g_wGaitPhase * bSteps) >> 16) + 1;
+  if (bGaitStep != g_InControlState.GaitStep) {
+    g_InControlState.GaitStep = bGaitStep;
+    if (g_InControlState.ForceGaitStepCnt)
+      g_InControlState.ForceGaitStepCnt--;
+  }
+}
+#endif
+
 //--------------------------------------------------------------------
 //[GAIT]
 void Gait (byte GaitCurrentLegNr)
 {
+  // One table lookup replaces the LegStep, NrLiftedPos and FrontDownPos checks
+  byte bPhase = g_abGaitPhase[g_InControlState.GaitStep + g_InControlState.gaitCur.StepsInGait - 1 - 
+    g_InControlState.gaitCur.GaitLegNr[GaitCurrentLegNr]];
+  byte bAct;
+
+  if (TravelRequest)
+    bAct = bPhase & cGaitActMask;
+  //Not walking: only lift the legs that are not in their home position yet
+  else if ((bPhase & cGaitPhaseUp) && ((abs(GaitPosX[GaitCurrentLegNr])>2) || 
+    (abs(GaitPosZ[GaitCurrentLegNr])>2) || (abs(GaitRotY[GaitCurrentLegNr])>2)))
+    bAct = cGaitActUp;
+  else
+    bAct = (bPhase & cGaitPhaseFrontDown)? cGaitActFrontDown : cGaitActMove;
 
-  // Try to reduce the number of time we look at GaitLegnr and Gaitstep
-  short int LegStep = g_InControlState.GaitStep - g_InControlState.gaitCur.GaitLegNr[GaitCurrentLegNr];
+  //The front down position only applies to a leg that is still up
+  if ((bAct == cGaitActFrontDown) && (GaitPosY[GaitCurrentLegNr] >= 0))
+    bAct = cGaitActMove;
 
+  switch (bAct) {
   //Leg middle up position OK
-  //Gait in motion	                                                                                  
-  // For Lifted pos = 1, 3, 5
-  if ((TravelRequest && (g_InControlState.gaitCur.NrLiftedPos&1) && 
-    LegStep==0) || (!TravelRequest && LegStep==0 && ((abs(GaitPosX[GaitCurrentLegNr])>2) || 
-    (abs(GaitPosZ[GaitCurrentLegNr])>2) || (abs(GaitRotY[GaitCurrentLegNr])>2)))) { //Up
+  //Gait in motion (Lifted pos = 1, 3, 5) or returning to the home position
+  case cGaitActUp:
     GaitPosX[GaitCurrentLegNr] = 0;
     GaitPosY[GaitCurrentLegNr] = -g_InControlState.LegLiftHeight;
     GaitPosZ[GaitCurrentLegNr] = 0;
     GaitRotY[GaitCurrentLegNr] = 0;
-  }
+    break;
+
   //Optional Half heigth Rear (2, 3, 5 lifted positions)
-  else if (((g_InControlState.gaitCur.NrLiftedPos==2 && LegStep==0) || (g_InControlState.gaitCur.NrLiftedPos>=3 && 
-    (LegStep==-1 || LegStep==(g_InControlState.gaitCur.StepsInGait-1))))
-    && TravelRequest) {
-    GaitPosX[GaitCurrentLegNr] = -g_InControlState.TravelLength.x/g_InControlState.gaitCur.LiftDivFactor;
-    GaitPosY[GaitCurrentLegNr] = -3*g_InControlState.LegLiftHeight/(3+g_InControlState.gaitCur.HalfLiftHeight);     //Easier to shift between div factor: /1 (3/3), /2 (3/6) and 3/4
-    GaitPosZ[GaitCurrentLegNr] = -g_InControlState.TravelLength.z/g_InControlState.gaitCur.LiftDivFactor;
-    GaitRotY[GaitCurrentLegNr] = -g_InControlState.TravelLength.y/g_InControlState.gaitCur.LiftDivFactor;
-  }    
-  // _A_	  
+  case cGaitActHalfRear:
+    GaitPosX[GaitCurrentLegNr] = -g_GaitFrame.TravelLift.x;
+    GaitPosY[GaitCurrentLegNr] = g_GaitFrame.HalfLiftY;
+    GaitPosZ[GaitCurrentLegNr] = -g_GaitFrame.TravelLift.z;
+    GaitRotY[GaitCurrentLegNr] = -g_GaitFrame.TravelLift.y;
+    break;
+
   // Optional Half heigth front (2, 3, 5 lifted positions)
-  else if ((g_InControlState.gaitCur.NrLiftedPos>=2) && (LegStep==1 || LegStep==-(g_InControlState.gaitCur.StepsInGait-1)) && TravelRequest) {
-    GaitPosX[GaitCurrentLegNr] = g_InControlState.TravelLength.x/g_InControlState.gaitCur.LiftDivFactor;
-    GaitPosY[GaitCurrentLegNr] = -3*g_InControlState.LegLiftHeight/(3+g_InControlState.gaitCur.HalfLiftHeight); // Easier to shift between div factor: /1 (3/3), /2 (3/6) and 3/4
-    GaitPosZ[GaitCurrentLegNr] = g_InControlState.TravelLength.z/g_InControlState.gaitCur.LiftDivFactor;
-    GaitRotY[GaitCurrentLegNr] = g_InControlState.TravelLength.y/g_InControlState.gaitCur.LiftDivFactor;
-  }
+  case cGaitActHalfFront:
+    GaitPosX[GaitCurrentLegNr] = g_GaitFrame.TravelLift.x;
+    GaitPosY[GaitCurrentLegNr] = g_GaitFrame.HalfLiftY;
+    GaitPosZ[GaitCurrentLegNr] = g_GaitFrame.TravelLift.z;
+    GaitRotY[GaitCurrentLegNr] = g_GaitFrame.TravelLift.y;
+    break;
 
   //Optional Half heigth Rear 5 LiftedPos (5 lifted positions)
-  else if (((g_InControlState.gaitCur.NrLiftedPos==5 && (LegStep==-2 ))) && TravelRequest) {
-    GaitPosX[GaitCurrentLegNr] = -g_InControlState.TravelLength.x/2;
-    GaitPosY[GaitCurrentLegNr] = -g_InControlState.LegLiftHeight/2;
-    GaitPosZ[GaitCurrentLegNr] = -g_InControlState.TravelLength.z/2;
-    GaitRotY[GaitCurrentLegNr] = -g_InControlState.TravelLength.y/2;
-  }  		
+  case cGaitActHalf5Rear:
+    GaitPosX[GaitCurrentLegNr] = -g_GaitFrame.TravelHalf.x;
+    GaitPosY[GaitCurrentLegNr] = g_GaitFrame.Half5LiftY;
+    GaitPosZ[GaitCurrentLegNr] = -g_GaitFrame.TravelHalf.z;
+    GaitRotY[GaitCurrentLegNr] = -g_GaitFrame.TravelHalf.y;
+    break;
 
   //Optional Half heigth Front 5 LiftedPos (5 lifted positions)
-  else if ((g_InControlState.gaitCur.NrLiftedPos==5) && (LegStep==2 || LegStep==-(g_InControlState.gaitCur.StepsInGait-2)) && TravelRequest) {
-    GaitPosX[GaitCurrentLegNr] = g_InControlState.TravelLength.x/2;
-    GaitPosY[GaitCurrentLegNr] = -g_InControlState.LegLiftHeight/2;
-    GaitPosZ[GaitCurrentLegNr] = g_InControlState.TravelLength.z/2;
-    GaitRotY[GaitCurrentLegNr] = g_InControlState.TravelLength.y/2;
-  }
-  //_B_
-  //Leg front down position //bug here?  From _A_ to _B_ there should only be one gaitstep, not 2!
-  //For example, where is the case of LegStep==0+2 executed when NRLiftedPos=3?
-  else if ((LegStep==g_InControlState.gaitCur.FrontDownPos || LegStep==-(g_InControlState.gaitCur.StepsInGait-g_InControlState.gaitCur.FrontDownPos)) && GaitPosY[GaitCurrentLegNr]<0) {
-    GaitPosX[GaitCurrentLegNr] = g_InControlState.TravelLength.x/2;
-    GaitPosZ[GaitCurrentLegNr] = g_InControlState.TravelLength.z/2;
-    GaitRotY[GaitCurrentLegNr] = g_InControlState.TravelLength.y/2;      	
-    GaitPosY[GaitCurrentLegNr] = 0;	
-  }
+  case cGaitActHalf5Front:
+    GaitPosX[GaitCurrentLegNr] = g_GaitFrame.TravelHalf.x;
+    GaitPosY[GaitCurrentLegNr] = g_GaitFrame.Half5LiftY;
+    GaitPosZ[GaitCurrentLegNr] = g_GaitFrame.TravelHalf.z;
+    GaitRotY[GaitCurrentLegNr] = g_GaitFrame.TravelHalf.y;
+    break;
+
+  //Leg front down position
+  case cGaitActFrontDown:
+    GaitPosX[GaitCurrentLegNr] = g_GaitFrame.TravelHalf.x;
+    GaitPosZ[GaitCurrentLegNr] = g_GaitFrame.TravelHalf.z;
+    GaitRotY[GaitCurrentLegNr] = g_GaitFrame.TravelHalf.y;
+    GaitPosY[GaitCurrentLegNr] = 0;
+    break;
 
   //Move body forward      
-  else {
-    GaitPosX[GaitCurrentLegNr] = GaitPosX[GaitCurrentLegNr] - (g_InControlState.TravelLength.x/(short)g_InControlState.gaitCur.TLDivFactor);
+  default:
+    GaitPosX[GaitCurrentLegNr] = GaitPosX[GaitCurrentLegNr] - g_GaitFrame.TravelStep.x;
     GaitPosY[GaitCurrentLegNr] = 0; 
-    GaitPosZ[GaitCurrentLegNr] = GaitPosZ[GaitCurrentLegNr] - (g_InControlState.TravelLength.z/(short)g_InControlState.gaitCur.TLDivFactor);
-    GaitRotY[GaitCurrentLegNr] = GaitRotY[GaitCurrentLegNr] - (g_InControlState.TravelLength.y/(short)g_InControlState.gaitCur.TLDivFactor);
+    GaitPosZ[GaitCurrentLegNr] = GaitPosZ[GaitCurrentLegNr] - g_GaitFrame.TravelStep.z;
+    GaitRotY[GaitCurrentLegNr] = GaitRotY[GaitCurrentLegNr] - g_GaitFrame.TravelStep.y;
+    break;
   }
 
 }  
@@ -1323,7 +2077,7 @@ void BalCalcOneLeg (long PosX, long PosZ, long PosY, byte BalLegNr)
       TotalTransZ += (long)CPR_Z;
       TotalTransX += (long)CPR_X;
 
-      lAtan = GetATan2(CPR_X, CPR_Z);
+      lAtan = ATan2Hyp(CPR_X, CPR_Z).Atan4;
       TotalYBal1 += (lAtan*1800) / 31415;
 #ifdef DEBUG
       if (g_fDebugOutput) {
@@ -1338,10 +2092,10 @@ void BalCalcOneLeg (long PosX, long PosZ, long PosY, byte BalLegNr)
       }    
 #endif
 
-      lAtan = GetATan2 (CPR_X, CPR_Y);
+      lAtan = ATan2Hyp (CPR_X, CPR_Y).Atan4;
       TotalZBal1 += ((lAtan*1800) / 31415) -900; //Rotate balance circle 90 deg
 
-      lAtan = GetATan2 (CPR_Z, CPR_Y);
+      lAtan = ATan2Hyp (CPR_Z, CPR_Y).Atan4;
       TotalXBal1 += ((lAtan*1800) / 31415) - 900; //Rotate balance circle 90 deg
 
 #ifdef QUADMODE
@@ -1417,9 +2171,9 @@ void BalanceBody(void)
         } else {
           COGAngle1 = g_InControlState.gaitCur.COGAngleStart1 + (g_InControlState.GaitStep-1) * g_InControlState.gaitCur.COGAngleStep1;
         }
-        GetSinCos(COGAngle1);
-        TotalTransX = (long)g_InControlState.gaitCur.COGRadius * (long)sin4 / c4DEC;
-        TotalTransZ = (long)g_InControlState.gaitCur.COGRadius * (long)cos4 / c4DEC;
+        SINCOS4 scCOG = SinCos(AngleDeg1ToBin(COGAngle1));
+        TotalTransX = (long)g_InControlState.gaitCur.COGRadius * (long)scCOG.sin4 / c4DEC;
+        TotalTransZ = (long)g_InControlState.gaitCur.COGRadius * (long)scCOG.cos4 / c4DEC;
 	
 #ifdef DEBUG
         if (g_fDebugOutput) {
@@ -1455,56 +2209,70 @@ void BalanceBody(void)
 #endif  
 }
 //--------------------------------------------------------------------
-//[GETSINCOS] Get the sinus and cosinus from the angle +/- multiple circles
-//AngleDeg1     - Input Angle in degrees
-//sin4        - Output Sinus of AngleDeg
-//cos4          - Output Cosinus of AngleDeg
-void GetSinCos(short AngleDeg1)
+//[ANGLEDEG1TOBIN] Convert an angle in degrees to a binary angle
+//AngleDeg1     - Input Angle in degrees, decimals = 1, +/- multiple circles
+//Returns the angle where 65536 = 360 deg, so wrapping the circle is free.
+//65536/3600 = 18.2044 is done as 18 + 13398/65536 to stay within 32 bits.
+word AngleDeg1ToBin(short AngleDeg1)
 {
-  short        ABSAngleDeg1;    //Absolute value of the Angle in Degrees, decimals = 1
-  //Get the absolute value of AngleDeg
-  if (AngleDeg1 < 0)
-    ABSAngleDeg1 = AngleDeg1 *-1;
-  else
-    ABSAngleDeg1 = AngleDeg1;
-
-  //Shift rotation to a full circle of 360 deg -> AngleDeg // 360
-  if (AngleDeg1 < 0)    //Negative values
-    AngleDeg1 = 3600-(ABSAngleDeg1-(3600*(ABSAngleDeg1/3600)));
-  else                //Positive values
-  AngleDeg1 = ABSAngleDeg1-(3600*(ABSAngleDeg1/3600));
+  return (word)AngleDeg1*18 + (word)(((long)AngleDeg1*13398 + 0x8000) >> 16);
+}
 
-  if (AngleDeg1>=0 && AngleDeg1<=900)     // 0 to 90 deg
-  {
-    sin4 = pgm_read_word(&GetSin[AngleDeg1/5]);             // 5 is the presision (0.5) of the table
-    cos4 = pgm_read_word(&GetSin[(900-(AngleDeg1))/5]);
-  }     
+//--------------------------------------------------------------------
+//[SINQ] Interpolated sinus for the first quadrant
+//wAngle        - Input binary angle 0 - 0x4000 (0 - 90 deg)
+//Returns the sinus, decimals = 4
+static short SinQ(word wAngle)
+{
+  byte   bIndex = wAngle >> 7;               // 128 table steps per quadrant
+  byte   bFrac = wAngle & 0x7f;
+  short  sin4 = pgm_read_word(&GetSinQ[bIndex]);
 
-  else if (AngleDeg1>900 && AngleDeg1<=1800)     // 90 to 180 deg
-  {
-    sin4 = pgm_read_word(&GetSin[(900-(AngleDeg1-900))/5]); // 5 is the presision (0.5) of the table    
-    cos4 = -pgm_read_word(&GetSin[(AngleDeg1-900)/5]);            
-  }    
-  else if (AngleDeg1>1800 && AngleDeg1<=2700) // 180 to 270 deg
-  {
-    sin4 = -pgm_read_word(&GetSin[(AngleDeg1-1800)/5]);     // 5 is the presision (0.5) of the table
-    cos4 = -pgm_read_word(&GetSin[(2700-AngleDeg1)/5]);
-  }    
+  if (bFrac)
+    sin4 += (((short)pgm_read_word(&GetSinQ[bIndex+1]) - sin4) * bFrac + 64) >> 7;
+  return sin4;
+}
 
-  else if(AngleDeg1>2700 && AngleDeg1<=3600) // 270 to 360 deg
-  {
-    sin4 = -pgm_read_word(&GetSin[(3600-AngleDeg1)/5]); // 5 is the presision (0.5) of the table    
-    cos4 = pgm_read_word(&GetSin[(AngleDeg1-2700)/5]);            
+//--------------------------------------------------------------------
+//[SINCOS] Get the sinus and cosinus from a binary angle
+//wAngle        - Input binary angle, 65536 = 360 deg (see AngleDeg1ToBin)
+//Returns the sinus and cosinus, decimals = 4
+SINCOS4 SinCos(word wAngle)
+{
+  SINCOS4 sc;
+  word    wQAngle = wAngle & 0x3fff;         // angle within the quadrant
+  short   sin4 = SinQ(wQAngle);
+  short   cos4 = SinQ(0x4000 - wQAngle);
+
+  switch (wAngle >> 14) {
+  case 0:    // 0 to 90 deg
+    sc.sin4 = sin4;
+    sc.cos4 = cos4;
+    break;
+  case 1:    // 90 to 180 deg
+    sc.sin4 = cos4;
+    sc.cos4 = -sin4;
+    break;
+  case 2:    // 180 to 270 deg
+    sc.sin4 = -sin4;
+    sc.cos4 = -cos4;
+    break;
+  default:   // 270 to 360 deg
+    sc.sin4 = -cos4;
+    sc.cos4 = sin4;
+    break;
   }
-}    
+  return sc;
+}
 
 
 //--------------------------------------------------------------------
 //(GETARCCOS) Get the sinus and cosinus from the angle +/- multiple circles
 //cos4        - Input Cosinus
-//AngleRad4     - Output Angle in AngleRad4
+//Returns the angle in radians, decimals = 4
 long GetArcCos(short cos4)
 {
+  short   AngleRad4;              //Output Angle in radials, decimals = 4
   boolean NegativeValue/*:1*/;    //If the the value is Negative
   //Check for negative value
   if (cos4<0)
@@ -1528,7 +2296,7 @@ long GetArcCos(short cos4)
     AngleRad4 = (byte)pgm_read_byte(&GetACos[(cos4-9000)/8+114]);
     AngleRad4 = (long)((long)AngleRad4*616)/c1DEC;             //616=acos resolution (pi/2/255) 
   }
-  else if ((cos4>=9900) && (cos4<=10000))
+  else    // 9900 - 10000, cos4 is limited above
   {
     AngleRad4 = (byte)pgm_read_byte(&GetACos[(cos4-9900)/2+227]);
     AngleRad4 = (long)((long)AngleRad4*616)/c1DEC;             //616=acos resolution (pi/2/255) 
@@ -1568,40 +2336,164 @@ unsigned long isqrt32 (unsigned long n) //
 
 
 //--------------------------------------------------------------------
-//(GETATAN2) Simplyfied ArcTan2 function based on fixed point ArcCos
-//ArcTanX         - Input X
-//ArcTanY         - Input Y
-//ArcTan4          - Output ARCTAN2(X/Y)
-//XYhyp2            - Output presenting Hypotenuse of X and Y
-short GetATan2 (short AtanX, short AtanY)
+//(ATAN2HYP STEP) One CORDIC vectoring step, unrolled with a template so
+//every shift is by a constant. The AVR has no barrel shifter, a long
+//shifted by a variable count loops one bit at a time, while a constant
+//count becomes byte moves plus at most 7 single bit shifts.
+template <byte i> struct ATan2HypStep {
+  static inline void Run(long &x, long &y, short &Angle4)
+  {
+    long xNew;
+    if (y > 0) {
+      xNew = x + (y >> i);
+      y -= x >> i;
+      Angle4 += pgm_read_word(&GetATanCordic[i]);
+    } 
+    else {
+      xNew = x - (y >> i);
+      y += x >> i;
+      Angle4 -= pgm_read_word(&GetATanCordic[i]);
+    }
+    x = xNew;
+    ATan2HypStep<i+1>::Run(x, y, Angle4);
+  }
+};
+
+template <> struct ATan2HypStep<sizeof(GetATanCordic)/sizeof(GetATanCordic[0])> {
+  static inline void Run(long &, long &, short &)
+  {
+  }
+};
+
+//--------------------------------------------------------------------
+//(ATAN2HYP) ArcTan2 and hypotenuse in one go using fixed point CORDIC
+//AtanX         - Input X
+//AtanY         - Input Y
+//Returns ARCTAN2(Y/X) in radians (-pi..pi), decimals = 4 and the
+//hypotenuse of X and Y, decimals = 2
+ATAN2HYP4 ATan2Hyp (short AtanX, short AtanY)
 {
-  XYhyp2 = isqrt32(((long)AtanX*AtanX*c4DEC) + ((long)AtanY*AtanY*c4DEC));
-  GetArcCos (((long)AtanX*(long)c6DEC) /(long) XYhyp2);
+  ATAN2HYP4  ah;
+  long       x;
+  long       y;
+  long       xNew;
+  short      Angle4 = 0;
+
+  //Scale by 100/K*256 (K = CORDIC gain 1.6468), so X ends up as the hypotenuse
+  //with decimals = 2 and 8 extra bits. Max 46341*25600 still fits in a long
+  x = (long)AtanX * 15546;
+  y = (long)AtanY * 15546;
+
+  //CORDIC only converges for -90..90 deg, so first rotate the left half plane 90 deg
+  if (x < 0) {
+    if (y >= 0) {
+      xNew = y;
+      y = -x;
+      Angle4 = 15708;
+    } 
+    else {
+      xNew = -y;
+      y = x;
+      Angle4 = -15708;
+    }
+    x = xNew;
+  }
 
-  if (AtanY < 0)                // removed overhead... Atan4 = AngleRad4 * (AtanY/abs(AtanY));  
-    Atan4 = -AngleRad4;
-  else
-    Atan4 = AngleRad4;
-  return Atan4;
+  //Rotate the vector onto the X axis and sum the angles needed to get there
+  ATan2HypStep<0>::Run(x, y, Angle4);
+
+  ah.Atan4 = Angle4;
+  ah.Hyp2 = (x + 128) >> 8;
+  return ah;
 }    
 
+//--------------------------------------------------------------------
+//(BODY FK SETUP) Collects the body position and rotation that are the same
+//for all legs. Called once per frame after BalanceBody
+//pBody            - Output body state for BodyFK and LegIK
+void BodyFKSetup(IKBODY *pBody)
+{
+  SINCOS4 sc;
+
+  pBody->PosX = g_InControlState.BodyPos.x;
+  pBody->PosY = g_InControlState.BodyPos.y;
+  pBody->PosZ = g_InControlState.BodyPos.z;
+  pBody->RotOffsetX = g_InControlState.BodyRotOffset.x;
+  pBody->RotOffsetY = g_InControlState.BodyRotOffset.y;
+  pBody->RotOffsetZ = g_InControlState.BodyRotOffset.z;
+  pBody->RotY1 = g_InControlState.BodyRot1.y;
+  pBody->BalY1 = TotalYBal1;
+#ifdef OPT_WALK_UPSIDE_DOWN
+  pBody->fUpsideDown = g_fRobotUpsideDown;
+#endif
+
+  sc = SinCos(AngleDeg1ToBin(g_InControlState.BodyRot1.x+TotalXBal1));
+  pBody->SinG4 = sc.sin4;
+  pBody->CosG4 = sc.cos4;
+
+  sc = SinCos(AngleDeg1ToBin(g_InControlState.BodyRot1.z+TotalZBal1)); 
+  pBody->SinB4 = sc.sin4;
+  pBody->CosB4 = sc.cos4;
+}
+
+//--------------------------------------------------------------------
+//[LEGS IK] Body and leg inverse kinematics for all legs in one go
+//pIn              - Input feet positions, in leg coordinates
+//pBody            - Input body state from BodyFKSetup
+//pOut             - Output angles and IK status for all legs
+//The right legs have a mirrored X axis, this only changes the sign
+//of the X terms, so both sides share the same code. The loop over the
+//legs is unrolled at compile time by LegsIKStep.
+template <byte Leg> struct LegsIKStep {
+  static inline byte Run(const IKLEGSIN *pIn, const IKBODY *pBody, IKLEGSOUT *pOut)
+  {
+    COORD3D  FKPos;
+    short    BodyPosX;
+    short    FeetPosX;
+    byte     bIKStatus;
+
+    if (IsLegMirrored(Leg)) {
+      BodyPosX = -pBody->PosX;
+      FeetPosX = -pIn->FeetPosX[Leg];
+    } 
+    else {
+      BodyPosX = pBody->PosX;
+      FeetPosX = pIn->FeetPosX[Leg];
+    }
+    FKPos = BodyFK(FeetPosX-BodyPosX, pIn->FeetPosZ[Leg]+pBody->PosZ, pIn->FeetPosY[Leg]+pBody->PosY,
+        pIn->RotY[Leg], Leg, pBody);
+
+    if (IsLegMirrored(Leg))
+      FKPos.x = -FKPos.x;
+    bIKStatus = LegIK<LegDOF<Leg>::f4DOF>(pIn->FeetPosX[Leg]+BodyPosX-FKPos.x, pIn->FeetPosY[Leg]+pBody->PosY-FKPos.y,
+        pIn->FeetPosZ[Leg]+pBody->PosZ-FKPos.z, Leg, pBody, pOut);
+    return bIKStatus | LegsIKStep<Leg+1>::Run(pIn, pBody, pOut);
+  }
+};
+
+template <> struct LegsIKStep<CNT_LEGS> {
+  static inline byte Run(const IKLEGSIN *, const IKBODY *, IKLEGSOUT *)
+  {
+    return 0;
+  }
+};
+
+void LegsIK (const IKLEGSIN *pIn, const IKBODY *pBody, IKLEGSOUT *pOut)
+{
+  pOut->bIKStatus = LegsIKStep<0>::Run(pIn, pBody, pOut);
+}
+
 //--------------------------------------------------------------------
 //(BODY INVERSE KINEMATICS) 
-//BodyRotX         - Global Input pitch of the body 
-//BodyRotY         - Global Input rotation of the body 
-//BodyRotZ         - Global Input roll of the body 
 //RotationY         - Input Rotation for the gait 
 //PosX            - Input position of the feet X 
 //PosZ            - Input position of the feet Z 
-//SinB                  - Sin buffer for BodyRotX
-//CosB               - Cos buffer for BodyRotX
-//SinG                  - Sin buffer for BodyRotZ
-//CosG               - Cos buffer for BodyRotZ
-//BodyFKPosX         - Output Position X of feet with Rotation 
-//BodyFKPosY         - Output Position Y of feet with Rotation 
-//BodyFKPosZ         - Output Position Z of feet with Rotation
-void BodyFK (short PosX, short PosZ, short PosY, short RotationY, byte BodyIKLeg) 
+//PosY            - Input position of the feet Y 
+//pBody           - Input body rotation and rotation offset, from BodyFKSetup
+//Returns the position of feet with Rotation
+COORD3D BodyFK (short PosX, short PosZ, short PosY, short RotationY, byte BodyIKLeg, const IKBODY *pBody) 
 {
+  COORD3D          FKPos;
   short            SinA4;          //Sin buffer for BodyRotX calculations
   short            CosA4;          //Cos buffer for BodyRotX calculations
   short            SinB4;          //Sin buffer for BodyRotX calculations
@@ -1613,43 +2505,43 @@ void BodyFK (short PosX, short PosZ, short PosY, short RotationY, byte BodyIKLeg
   short            CPR_Z;            //Final Z value for centerpoint of rotation
 
   //Calculating totals from center of the body to the feet 
-  CPR_X = (short)pgm_read_word(&cOffsetX[BodyIKLeg])+PosX + g_InControlState.BodyRotOffset.x;
-  CPR_Y = PosY + g_InControlState.BodyRotOffset.y;         //Define centerpoint for rotation along the Y-axis
-  CPR_Z = (short)pgm_read_word(&cOffsetZ[BodyIKLeg]) + PosZ + g_InControlState.BodyRotOffset.z;
+  CPR_X = (short)pgm_read_word(&cOffsetX[BodyIKLeg])+PosX + pBody->RotOffsetX;
+  CPR_Y = PosY + pBody->RotOffsetY;         //Define centerpoint for rotation along the Y-axis
+  CPR_Z = (short)pgm_read_word(&cOffsetZ[BodyIKLeg]) + PosZ + pBody->RotOffsetZ;
 
   //Successive global rotation matrix: 
   //Math shorts for rotation: Alfa [A] = Xrotate, Beta [B] = Zrotate, Gamma [G] = Yrotate 
   //Sinus Alfa = SinA, cosinus Alfa = cosA. and so on... 
 
-  //First calculate sinus and cosinus for each rotation: 
-  GetSinCos (g_InControlState.BodyRot1.x+TotalXBal1);
-  SinG4 = sin4;
-  CosG4 = cos4;
-
-  GetSinCos (g_InControlState.BodyRot1.z+TotalZBal1); 
-  SinB4 = sin4;
-  CosB4 = cos4;
+  //Sinus and cosinus of the X and Z rotation are calculated once per frame in BodyFKSetup
+  SinG4 = pBody->SinG4;
+  CosG4 = pBody->CosG4;
+  SinB4 = pBody->SinB4;
+  CosB4 = pBody->CosB4;
 
+  //Only the Y rotation depends on the leg (gait rotation)
+  SINCOS4 scA;
 #ifdef OPT_WALK_UPSIDE_DOWN
-  if (g_fRobotUpsideDown)
-    GetSinCos (-g_InControlState.BodyRot1.y+(-RotationY*c1DEC)+TotalYBal1) ;
+  if (pBody->fUpsideDown)
+    scA = SinCos(AngleDeg1ToBin(-pBody->RotY1+(-RotationY*c1DEC)+pBody->BalY1)) ;
   else
-    GetSinCos (g_InControlState.BodyRot1.y+(RotationY*c1DEC)+TotalYBal1) ;
+    scA = SinCos(AngleDeg1ToBin(pBody->RotY1+(RotationY*c1DEC)+pBody->BalY1)) ;
 #else
-  GetSinCos (g_InControlState.BodyRot1.y+(RotationY*c1DEC)+TotalYBal1) ;
+  scA = SinCos(AngleDeg1ToBin(pBody->RotY1+(RotationY*c1DEC)+pBody->BalY1)) ;
 #endif
-  SinA4 = sin4;
-  CosA4 = cos4;
+  SinA4 = scA.sin4;
+  CosA4 = scA.cos4;
 
   //Calcualtion of rotation matrix: 
-  BodyFKPosX = ((long)CPR_X*c2DEC - ((long)CPR_X*c2DEC*CosA4/c4DEC*CosB4/c4DEC - (long)CPR_Z*c2DEC*CosB4/c4DEC*SinA4/c4DEC 
+  FKPos.x = ((long)CPR_X*c2DEC - ((long)CPR_X*c2DEC*CosA4/c4DEC*CosB4/c4DEC - (long)CPR_Z*c2DEC*CosB4/c4DEC*SinA4/c4DEC 
     + (long)CPR_Y*c2DEC*SinB4/c4DEC ))/c2DEC;
-  BodyFKPosZ = ((long)CPR_Z*c2DEC - ( (long)CPR_X*c2DEC*CosG4/c4DEC*SinA4/c4DEC + (long)CPR_X*c2DEC*CosA4/c4DEC*SinB4/c4DEC*SinG4/c4DEC 
+  FKPos.z = ((long)CPR_Z*c2DEC - ( (long)CPR_X*c2DEC*CosG4/c4DEC*SinA4/c4DEC + (long)CPR_X*c2DEC*CosA4/c4DEC*SinB4/c4DEC*SinG4/c4DEC 
     + (long)CPR_Z*c2DEC*CosA4/c4DEC*CosG4/c4DEC - (long)CPR_Z*c2DEC*SinA4/c4DEC*SinB4/c4DEC*SinG4/c4DEC 
     - (long)CPR_Y*c2DEC*CosB4/c4DEC*SinG4/c4DEC ))/c2DEC;
-  BodyFKPosY = ((long)CPR_Y  *c2DEC - ( (long)CPR_X*c2DEC*SinA4/c4DEC*SinG4/c4DEC - (long)CPR_X*c2DEC*CosA4/c4DEC*CosG4/c4DEC*SinB4/c4DEC 
+  FKPos.y = ((long)CPR_Y  *c2DEC - ( (long)CPR_X*c2DEC*SinA4/c4DEC*SinG4/c4DEC - (long)CPR_X*c2DEC*CosA4/c4DEC*CosG4/c4DEC*SinB4/c4DEC 
     + (long)CPR_Z*c2DEC*CosA4/c4DEC*SinG4/c4DEC + (long)CPR_Z*c2DEC*CosG4/c4DEC*SinA4/c4DEC*SinB4/c4DEC 
     + (long)CPR_Y*c2DEC*CosB4/c4DEC*CosG4/c4DEC ))/c2DEC;
+  return FKPos;
 }  
 
 
@@ -1659,19 +2551,26 @@ void BodyFK (short PosX, short PosZ, short PosY, short RotationY, byte BodyIKLeg
 //IKFeetPosX            - Input position of the Feet X
 //IKFeetPosY            - Input position of the Feet Y
 //IKFeetPosZ            - Input Position of the Feet Z
-//IKSolution            - Output true if the solution is possible
-//IKSolutionWarning     - Output true if the solution is NEARLY possible
-//IKSolutionError    - Output true if the solution is NOT possible
-//FemurAngle1           - Output Angle of Femur in degrees
-//TibiaAngle1           - Output Angle of Tibia in degrees
-//CoxaAngle1            - Output Angle of Coxa in degrees
-//--------------------------------------------------------------------
-void LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegNr)
+//pBody                 - Input body state (upside down)
+//pOut->FemurAngle1     - Output Angle of Femur in degrees
+//pOut->TibiaAngle1     - Output Angle of Tibia in degrees
+//pOut->CoxaAngle1      - Output Angle of Coxa in degrees
+//f4DOF                 - Template, true if this leg has a tars
+//Returns the cIKSolution, cIKSolutionWarning or cIKSolutionError bit
+//--------------------------------------------------------------------
+template <bool f4DOF> byte LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegNr, const IKBODY *pBody, IKLEGSOUT *pOut)
 {
+  byte             bIKStatus;
+  byte             bCoxaLength = pgm_read_byte(&cCoxaLength[LegIKLegNr]);
+  byte             bFemurLength = pgm_read_byte(&cFemurLength[LegIKLegNr]);
+  byte             bTibiaLength = pgm_read_byte(&cTibiaLength[LegIKLegNr]);
   unsigned long    IKSW2;            //Length between Shoulder and Wrist, decimals = 2
   unsigned long    IKA14;            //Angle of the line S>W with respect to the ground in radians, decimals = 4
   unsigned long    IKA24;            //Angle of the line S>W with respect to the femur in radians, decimals = 4
   short            IKFeetPosXZ;    //Diagonal direction from Input X and Z
+#ifndef OPT_WALK_UPSIDE_DOWN
+  (void)pBody;                     //Only needed for the upside down angles
+#endif
 #ifdef c4DOF
   // these were shorts...
   long            TarsOffsetXZ;    //Vector value \ ;
@@ -1688,17 +2587,19 @@ void LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegN
   long            Temp1;            
   long            Temp2;            
   long            T3;
+  short           IKA34;            //Angle between the femur and the tibia in radians, decimals = 4
+  ATAN2HYP4       ah;
 
   //Calculate IKCoxaAngle and IKFeetPosXZ
-  GetATan2 (IKFeetPosX, IKFeetPosZ);
-  CoxaAngle1[LegIKLegNr] = (((long)Atan4*180) / 3141) + (short)pgm_read_word(&cCoxaAngle1[LegIKLegNr]);
+  ah = ATan2Hyp (IKFeetPosX, IKFeetPosZ);
+  pOut->CoxaAngle1[LegIKLegNr] = (((long)ah.Atan4*180) / 3141) + (short)pgm_read_word(&cCoxaAngle1[LegIKLegNr]);
 
   //Length between the Coxa and tars [foot]
-  IKFeetPosXZ = XYhyp2/c2DEC;
+  IKFeetPosXZ = ah.Hyp2/c2DEC;
 #ifdef c4DOF
   // Some legs may have the 4th DOF and some may not, so handle this here...
   //Calc the TarsToGroundAngle1:
-  if ((byte)pgm_read_byte(&cTarsLength[LegIKLegNr])) {    // We allow mix of 3 and 4 DOF legs...
+  if (f4DOF) {    // We allow mix of 3 and 4 DOF legs...
     TarsToGroundAngle1 = -cTarsConst + cTarsMulti*IKFeetPosY + ((long)(IKFeetPosXZ*cTarsFactorA))/c1DEC - ((long)(IKFeetPosXZ*IKFeetPosY)/(cTarsFactorB));
     if (IKFeetPosY < 0)     //Always compensate TarsToGroundAngle1 when IKFeetPosY it goes below zero
       TarsToGroundAngle1 = TarsToGroundAngle1 - ((long)(IKFeetPosY*cTarsFactorC)/c1DEC);     //TGA base, overall rule
@@ -1720,9 +2621,9 @@ void LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegN
     TarsToGroundAngle1 = TGA_B_H3;
 
     //Calc Tars Offsets:
-    GetSinCos(TarsToGroundAngle1);
-    TarsOffsetXZ = ((long)sin4*(byte)pgm_read_byte(&cTarsLength[LegIKLegNr]))/c4DEC;
-    TarsOffsetY = ((long)cos4*(byte)pgm_read_byte(&cTarsLength[LegIKLegNr]))/c4DEC;
+    SINCOS4 scTGA = SinCos(AngleDeg1ToBin(TarsToGroundAngle1));
+    TarsOffsetXZ = ((long)scTGA.sin4*(byte)pgm_read_byte(&cTarsLength[LegIKLegNr]))/c4DEC;
+    TarsOffsetY = ((long)scTGA.cos4*(byte)pgm_read_byte(&cTarsLength[LegIKLegNr]))/c4DEC;
   } 
   else {
     TarsOffsetXZ = 0;
@@ -1730,16 +2631,17 @@ void LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegN
   }
 #endif
 
-  //Using GetAtan2 for solving IKA1 and IKSW
+  //Using ATan2Hyp for solving IKA1 and IKSW
   //IKA14 - Angle between SW line and the ground in radians
-  IKA14 = GetATan2 (IKFeetPosY-TarsOffsetY, IKFeetPosXZ-(byte)pgm_read_byte(&cCoxaLength[LegIKLegNr])-TarsOffsetXZ);
+  ah = ATan2Hyp (IKFeetPosY-TarsOffsetY, IKFeetPosXZ-bCoxaLength-TarsOffsetXZ);
+  IKA14 = ah.Atan4;
 
   //IKSW2 - Length between femur axis and tars
-  IKSW2 = XYhyp2;
+  IKSW2 = ah.Hyp2;
 
   //IKA2 - Angle of the line S>W with respect to the femur in radians
-  Temp1 = ((((long)(byte)pgm_read_byte(&cFemurLength[LegIKLegNr])*(byte)pgm_read_byte(&cFemurLength[LegIKLegNr])) - ((long)(byte)pgm_read_byte(&cTibiaLength[LegIKLegNr])*(byte)pgm_read_byte(&cTibiaLength[LegIKLegNr])))*c4DEC + ((long)IKSW2*IKSW2));
-  Temp2 = (long)(2*(byte)pgm_read_byte(&cFemurLength[LegIKLegNr]))*c2DEC * (unsigned long)IKSW2;
+  Temp1 = ((((long)bFemurLength*bFemurLength) - ((long)bTibiaLength*bTibiaLength))*c4DEC + ((long)IKSW2*IKSW2));
+  Temp2 = (long)(2*bFemurLength)*c2DEC * (unsigned long)IKSW2;
   T3 = Temp1 / (Temp2/c4DEC);
   IKA24 = GetArcCos (T3 );
 #ifdef DEBUG_IK
@@ -1760,18 +2662,18 @@ void LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegN
 #endif
   //IKFemurAngle
 #ifdef OPT_WALK_UPSIDE_DOWN
-  if (g_fRobotUpsideDown)
-    FemurAngle1[LegIKLegNr] = (long)(IKA14 + IKA24) * 180 / 3141 - 900 + CFEMURHORNOFFSET1(LegIKLegNr);//Inverted, up side down
+  if (pBody->fUpsideDown)
+    pOut->FemurAngle1[LegIKLegNr] = (long)(IKA14 + IKA24) * 180 / 3141 - 900 + CFEMURHORNOFFSET1(LegIKLegNr);//Inverted, up side down
   else
-    FemurAngle1[LegIKLegNr] = -(long)(IKA14 + IKA24) * 180 / 3141 + 900 + CFEMURHORNOFFSET1(LegIKLegNr);//Normal
+    pOut->FemurAngle1[LegIKLegNr] = -(long)(IKA14 + IKA24) * 180 / 3141 + 900 + CFEMURHORNOFFSET1(LegIKLegNr);//Normal
 #else
-  FemurAngle1[LegIKLegNr] = -(long)(IKA14 + IKA24) * 180 / 3141 + 900 + CFEMURHORNOFFSET1(LegIKLegNr);//Normal
+  pOut->FemurAngle1[LegIKLegNr] = -(long)(IKA14 + IKA24) * 180 / 3141 + 900 + CFEMURHORNOFFSET1(LegIKLegNr);//Normal
 #endif  
 
   //IKTibiaAngle
-  Temp1 = ((((long)(byte)pgm_read_byte(&cFemurLength[LegIKLegNr])*(byte)pgm_read_byte(&cFemurLength[LegIKLegNr])) + ((long)(byte)pgm_read_byte(&cTibiaLength[LegIKLegNr])*(byte)pgm_read_byte(&cTibiaLength[LegIKLegNr])))*c4DEC - ((long)IKSW2*IKSW2));
-  Temp2 = 2 * ((long)((byte)pgm_read_byte(&cFemurLength[LegIKLegNr]))) * (long)((byte)pgm_read_byte(&cTibiaLength[LegIKLegNr])); 
-  GetArcCos (Temp1 / Temp2);
+  Temp1 = ((((long)bFemurLength*bFemurLength) + ((long)bTibiaLength*bTibiaLength))*c4DEC - ((long)IKSW2*IKSW2));
+  Temp2 = 2 * ((long)(bFemurLength)) * (long)(bTibiaLength); 
+  IKA34 = GetArcCos (Temp1 / Temp2);
 #ifdef DEBUG_IK
     if (g_fDebugOutput && g_InControlState.fRobotOn) {
         DBGSerial.print("=");
@@ -1779,40 +2681,40 @@ void LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegN
         DBGSerial.print(" ");
         DBGSerial.print(Temp2, DEC);
         DBGSerial.print(" ");
-        DBGSerial.print(AngleRad4, DEC);
+        DBGSerial.print(IKA34, DEC);
     }
 #endif
     
 #ifdef OPT_WALK_UPSIDE_DOWN
-  if (g_fRobotUpsideDown)
-    TibiaAngle1[LegIKLegNr] = (1800-(long)AngleRad4*180/3141 + CTIBIAHORNOFFSET1(LegIKLegNr));//Full range tibia, wrong side (up side down)
+  if (pBody->fUpsideDown)
+    pOut->TibiaAngle1[LegIKLegNr] = (1800-(long)IKA34*180/3141 + CTIBIAHORNOFFSET1(LegIKLegNr));//Full range tibia, wrong side (up side down)
   else
-    TibiaAngle1[LegIKLegNr] = -(1800-(long)AngleRad4*180/3141 + CTIBIAHORNOFFSET1(LegIKLegNr));//Full range tibia, right side (up side up)
+    pOut->TibiaAngle1[LegIKLegNr] = -(1800-(long)IKA34*180/3141 + CTIBIAHORNOFFSET1(LegIKLegNr));//Full range tibia, right side (up side up)
 #else
 #ifdef PHANTOMX_V2     // BugBug:: cleaner way?  
-    TibiaAngle1[LegIKLegNr] = -(1450-(long)AngleRad4*180/3141 + CTIBIAHORNOFFSET1(LegIKLegNr)); //!!!!!!!!!!!!145 instead of 1800  
+    pOut->TibiaAngle1[LegIKLegNr] = -(1450-(long)IKA34*180/3141 + CTIBIAHORNOFFSET1(LegIKLegNr)); //!!!!!!!!!!!!145 instead of 1800  
 #else  
-    TibiaAngle1[LegIKLegNr] = -(900-(long)AngleRad4*180/3141 + CTIBIAHORNOFFSET1(LegIKLegNr));
+    pOut->TibiaAngle1[LegIKLegNr] = -(900-(long)IKA34*180/3141 + CTIBIAHORNOFFSET1(LegIKLegNr));
 #endif
 #endif
 
 #ifdef c4DOF
   //Tars angle
-  if ((byte)pgm_read_byte(&cTarsLength[LegIKLegNr])) {    // We allow mix of 3 and 4 DOF legs...
-    TarsAngle1[LegIKLegNr] = (TarsToGroundAngle1 + FemurAngle1[LegIKLegNr] - TibiaAngle1[LegIKLegNr]) 
+  if (f4DOF) {    // We allow mix of 3 and 4 DOF legs...
+    pOut->TarsAngle1[LegIKLegNr] = (TarsToGroundAngle1 + pOut->FemurAngle1[LegIKLegNr] - pOut->TibiaAngle1[LegIKLegNr]) 
       + CTARSHORNOFFSET1(LegIKLegNr);
   }
 #endif
 
   //Set the Solution quality    
-  if(IKSW2 < ((word)((byte)pgm_read_byte(&cFemurLength[LegIKLegNr])+(byte)pgm_read_byte(&cTibiaLength[LegIKLegNr])-30)*c2DEC))
-    IKSolution = 1;
+  if(IKSW2 < ((word)(bFemurLength+bTibiaLength-30)*c2DEC))
+    bIKStatus = cIKSolution;
   else
   {
-    if(IKSW2 < ((word)((byte)pgm_read_byte(&cFemurLength[LegIKLegNr])+(byte)pgm_read_byte(&cTibiaLength[LegIKLegNr]))*c2DEC)) 
-      IKSolutionWarning = 1;
+    if(IKSW2 < ((word)(bFemurLength+bTibiaLength)*c2DEC)) 
+      bIKStatus = cIKSolutionWarning;
     else
-      IKSolutionError = 1    ;
+      bIKStatus = cIKSolutionError;
   }
 #ifdef DEBUG
     if (g_fDebugOutput && g_InControlState.fRobotOn) {
@@ -1823,27 +2725,28 @@ void LegIK (short IKFeetPosX, short IKFeetPosY, short IKFeetPosZ, byte LegIKLegN
         DBGSerial.print(",");
         DBGSerial.print(IKFeetPosZ, DEC);
         DBGSerial.print(")=<");
-        DBGSerial.print(CoxaAngle1[LegIKLegNr], DEC);
+        DBGSerial.print(pOut->CoxaAngle1[LegIKLegNr], DEC);
         DBGSerial.print(",");
-        DBGSerial.print(FemurAngle1[LegIKLegNr], DEC);
+        DBGSerial.print(pOut->FemurAngle1[LegIKLegNr], DEC);
         DBGSerial.print(",");
-        DBGSerial.print(TibiaAngle1[LegIKLegNr], DEC);
+        DBGSerial.print(pOut->TibiaAngle1[LegIKLegNr], DEC);
         DBGSerial.print(">");
-        DBGSerial.print((IKSolutionError<<2)+(IKSolutionWarning<<1)+IKSolution, DEC);
+        DBGSerial.print(bIKStatus, DEC);
         if (LegIKLegNr == (CNT_LEGS-1))
             DBGSerial.println();
     }
 #endif  
+  return bIKStatus;
 }
 
 //--------------------------------------------------------------------
 //[CHECK ANGLES] Checks the mechanical limits of the servos
 //--------------------------------------------------------------------
-short CheckServoAngleBounds(short sID,  short sVal, const short *sMin PROGMEM, const short *sMax PROGMEM) {
+short CheckServoAngleBounds(short sID,  short sVal, short sMin, short sMax) {
 
     // Pull into simple function as so I can report errors on debug 
     // Note ID is bogus, but something to let me know which one.
-    short s = (short)pgm_read_word(sMin);
+    short s = sMin;
     if (sVal < s) {
 #ifdef DEBUG_BOUNDS
       if (g_fDebugOutput) {
@@ -1857,7 +2760,7 @@ short CheckServoAngleBounds(short sID,  short sVal, const short *sMin PROGMEM, c
         return s;
     }
 
-    s = (short)pgm_read_word(sMax);
+    s = sMax;
     if (sVal > s) {
 #ifdef DEBUG_BOUNDS
       if (g_fDebugOutput) {
@@ -1876,22 +2779,37 @@ short CheckServoAngleBounds(short sID,  short sVal, const short *sMin PROGMEM, c
 
 //--------------------------------------------------------------------
 //[CHECK ANGLES] Checks the mechanical limits of the servos
+//The loop over the legs is unrolled at compile time by CheckAnglesStep,
+//so the limits are constants instead of table reads.
 //--------------------------------------------------------------------
-void CheckAngles(void)
-{
 #ifndef SERVOS_DO_MINMAX
-  short s = 0;      // BUGBUG just some index so we can get a hint who errored out
-  for (LegIndex = 0; LegIndex < CNT_LEGS; LegIndex++)
+template <byte Leg> struct CheckAnglesStep {
+  static inline void Run(IKLEGSOUT *pOut)
   {
-    CoxaAngle1[LegIndex]  = CheckServoAngleBounds(s++, CoxaAngle1[LegIndex], &cCoxaMin1[LegIndex], &cCoxaMax1[LegIndex]);
-    FemurAngle1[LegIndex] = CheckServoAngleBounds(s++, FemurAngle1[LegIndex], &cFemurMin1[LegIndex], &cFemurMax1[LegIndex]);
-    TibiaAngle1[LegIndex] = CheckServoAngleBounds(s++, TibiaAngle1[LegIndex], &cTibiaMin1[LegIndex], &cTibiaMax1[LegIndex]);
+    short s = Leg*4;      // BUGBUG just some index so we can get a hint who errored out
+    pOut->CoxaAngle1[Leg]  = CheckServoAngleBounds(s++, pOut->CoxaAngle1[Leg], LegLimits<Leg>::CoxaMin1, LegLimits<Leg>::CoxaMax1);
+    pOut->FemurAngle1[Leg] = CheckServoAngleBounds(s++, pOut->FemurAngle1[Leg], LegLimits<Leg>::FemurMin1, LegLimits<Leg>::FemurMax1);
+    pOut->TibiaAngle1[Leg] = CheckServoAngleBounds(s++, pOut->TibiaAngle1[Leg], LegLimits<Leg>::TibiaMin1, LegLimits<Leg>::TibiaMax1);
 #ifdef c4DOF
-    if ((byte)pgm_read_byte(&cTarsLength[LegIndex])) {    // We allow mix of 3 and 4 DOF legs...
-      TarsAngle1[LegIndex] = CheckServoAngleBounds(s++, TarsAngle1[LegIndex], &cTarsMin1[LegIndex], &cTarsMax1[LegIndex]);
+    if (LegDOF<Leg>::f4DOF) {    // We allow mix of 3 and 4 DOF legs...
+      pOut->TarsAngle1[Leg] = CheckServoAngleBounds(s++, pOut->TarsAngle1[Leg], LegLimits<Leg>::TarsMin1, LegLimits<Leg>::TarsMax1);
     }
 #endif
+    CheckAnglesStep<Leg+1>::Run(pOut);
+  }
+};
+
+template <> struct CheckAnglesStep<CNT_LEGS> {
+  static inline void Run(IKLEGSOUT *)
+  {
   }
+};
+#endif
+
+void CheckAngles(void)
+{
+#ifndef SERVOS_DO_MINMAX
+  CheckAnglesStep<0>::Run(&g_LegsIKOut);
 #endif  
 }
 
@@ -1963,17 +2881,18 @@ void AdjustLegPositions(word XZLength1)
         DBGSerial.print(")->");
       }
 #endif
+      SINCOS4 sc;
 #ifdef OPT_DYNAMIC_ADJUST_LEGS
-      GetSinCos(g_InControlState.aCoxaInitAngle1[LegIndex]);
+      sc = SinCos(AngleDeg1ToBin(g_InControlState.aCoxaInitAngle1[LegIndex]));
 #else
 #ifdef cRRInitCoxaAngle1    // We can set different angles for the legs than just where they servo horns are set...
-      GetSinCos((short)pgm_read_word(&cCoxaInitAngle1[LegIndex]));
+      sc = SinCos(AngleDeg1ToBin((short)pgm_read_word(&cCoxaInitAngle1[LegIndex])));
 #else
-      GetSinCos((short)pgm_read_word(&cCoxaAngle1[LegIndex]));
+      sc = SinCos(AngleDeg1ToBin((short)pgm_read_word(&cCoxaAngle1[LegIndex])));
 #endif      
 #endif      
-      LegPosX[LegIndex] = ((long)((long)cos4 * XZLength1))/c4DEC;  //Set start positions for each leg
-      LegPosZ[LegIndex] = -((long)((long)sin4 * XZLength1))/c4DEC;
+      LegPosX[LegIndex] = ((long)((long)sc.cos4 * XZLength1))/c4DEC;  //Set start positions for each leg
+      LegPosZ[LegIndex] = -((long)((long)sc.sin4 * XZLength1))/c4DEC;
 #ifdef DEBUG
       if (g_fDebugOutput) {
         DBGSerial.print("(");
@@ -2147,6 +3066,9 @@ void MSound(byte cNotes, ...)
   va_list ap;
   unsigned int uDur;
   unsigned int uFreq;
+#ifdef OPT_SSC_TX_RING
+  SSCTxFlush();   // the sound holds up the loop, get the servo move out first
+#endif
   va_start(ap, cNotes);
 
   while (cNotes > 0) {
@@ -2197,6 +3119,9 @@ boolean TerminalMonitor(void)
 #ifdef OPT_DYNAMIC_ADJUST_LEGS
     DBGSerial.println(F("I pos ang"));
 #endif
+#ifdef OPT_LOOP_PROFILER
+    DBGSerial.println(F("L - Dump and reset loop timing"));
+#endif
 #ifdef OPT_TERMINAL_MONITOR_IC    // Allow the input controller to define stuff as well
     g_InputController.ShowTerminalCommandList(); 
 #endif      
@@ -2258,6 +3183,12 @@ boolean TerminalMonitor(void)
       UpdateInitialPosAndAngCmd(szCmdLine);
     } 
 #endif
+#ifdef OPT_LOOP_PROFILER
+    else if ((ich == 1) && ((szCmdLine[0] == 'l') || (szCmdLine[0] == 'L'))) {
+      LoopProfileDump();
+      LoopProfileReset();
+    } 
+#endif
 #ifdef OPT_TERMINAL_MONITOR_IC    // Allow the input controller to define stuff as well
     else if (g_InputController.ProcessTerminalCommand(szCmdLine, ich)) 
       ;  // See if the Input controller has added commands...
@@ -29,9 +29,17 @@
 #ifdef OPT_TERMINAL_MONITOR   // turning off terminal monitor will turn these off as well...
 #define OPT_SSC_FORWARDER  // only useful if terminal monitor is enabled
 //#define OPT_FIND_SERVO_OFFSETS    // Only useful if terminal monitor is enabled
+//#define OPT_LOOP_PROFILER     // Loop timing per phase, L command to dump; only useful if terminal monitor is enabled
 #endif
 
 #define OPT_GPPLAYER
+//#define OPT_SSC_ASYNC_QUERY   // GP player does not wait for the SSC-32 to answer its queries
+//#define OPT_SSC_TX_RING       // Group moves go out from a ring in the background, the loop does not wait for them
+#if defined(OPT_SSC_ASYNC_QUERY) || defined(OPT_SSC_TX_RING)
+#define OPT_BACKGROUND_PROCESS  // the servo driver does these in its background process
+#endif
+//#define OPT_GAIT_CONTINUOUS   // Continuous phase gait with smooth foot paths, at a fixed control rate
+//#define OPT_CONTROL_SCHEDULER // Fixed rate control loop, input and IK every tick instead of every gait step
 
 // Which type of control(s) do you want to compile in
 #define DBGSerial         Serial
@@ -50,6 +58,7 @@
 // THex-3
 //==================================================================================================================================
 #define USE_SSC32
+//#define OPT_SSC_DELTA_MOVES   // Only send the servos that moved, all of them every cSSCFullRefresh frames
 //#define	cSSC_BINARYMODE	1			// Define if your SSC-32 card supports binary mode.
 
 //[SERIAL CONNECTIONS]
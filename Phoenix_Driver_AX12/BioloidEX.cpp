@@ -35,9 +35,12 @@ BioloidControllerEx::BioloidControllerEx(long baud){
     nextpose_[i] = 512;
   }
   frameLength = BIOLOID_FRAME_LENGTH;
+  adaptiveFrame = 1;
+  busTime = 0;
   interpolating = 0;
   playing = 0;
   nextframe_ = millis();
+  syncWrite_.setup(AX_GOAL_POSITION_L, 2, AX12_MAX_SERVOS);
   ax12Init(baud);  
 }
 
@@ -56,6 +59,10 @@ void BioloidControllerEx::setup(int servo_cnt){
     pose_[i] = 512;
     nextpose_[i] = 512;
   }
+  syncWrite_.setup(AX_GOAL_POSITION_L, 2, servo_cnt);
+  frameLength = BIOLOID_FRAME_LENGTH;
+  adaptiveFrame = 1;
+  busTime = 0;
   interpolating = 0;
   playing = 0;
   nextframe_ = millis();
@@ -74,98 +81,96 @@ void BioloidControllerEx::loadPose( const unsigned int * addr ){
   for(i=0; i<poseSize; i++)
     nextpose_[i] = pgm_read_word_near(addr+1+i) << BIOLOID_SHIFT;
 }
-/* read in current servo positions to the pose. */
+/* read in current servo positions to the pose, one READ_DATA right after the other.
+   A servo that does not answer keeps the position it had in the pose. */
 void BioloidControllerEx::readPose(){
   for(int i=0;i<poseSize;i++){
-    pose_[i] = ax12GetRegister(id_[i],AX_PRESENT_POSITION_L,2)<<BIOLOID_SHIFT;
-    delay(25);   
+    int pos = ax12GetRegisterRetry(id_[i],AX_PRESENT_POSITION_L,2);
+    if(pos >= 0)
+      pose_[i] = pos<<BIOLOID_SHIFT;
   }
+  syncWrite_.invalidate();    // the servos may not be where we last sent them
 }
-/* write pose out to servos using sync write. */
+/* write pose out to servos using sync write, only the ones that moved. */
 void BioloidControllerEx::writePose(){
-  int temp;
-  int length = 4 + (poseSize * 3);   // 3 = id + pos(2byte)
-  int checksum = 254 + length + AX_SYNC_WRITE + 2 + AX_GOAL_POSITION_L;
-  setTXall();
-  ax12write(0xFF);
-  ax12write(0xFF);
-  ax12write(0xFE);
-  ax12write(length);
-  ax12write(AX_SYNC_WRITE);
-  ax12write(AX_GOAL_POSITION_L);
-  ax12write(2);
-  for(int i=0; i<poseSize; i++)
-  {
-    temp = pose_[i] >> BIOLOID_SHIFT;
-    checksum += (temp&0xff) + (temp>>8) + id_[i];
-    ax12write(id_[i]);
-    ax12write(temp&0xff);
-    ax12write(temp>>8);
-  } 
-  ax12write(0xff - (checksum % 256));
-  setRX(0);
+  if(syncWrite_.count() != poseSize)
+    syncWrite_.setCount(poseSize);
+  for(int i=0; i<poseSize; i++){
+    syncWrite_.setId(i, id_[i]);
+    syncWrite_.setWord(i, 0, pose_[i] >> BIOLOID_SHIFT);
+  }
+  syncWrite_.write();
 }
 
 /* set up for an interpolation from pose to nextpose over TIME 
- milliseconds by setting servo speeds. */
+ milliseconds.  Each frame puts the servos where they should be at that
+ time, so the move ends on time however often the frames come.  The move
+ ends on nextpose as it is now, callers may set the next one meanwhile. */
 void BioloidControllerEx::interpolateSetup(int time){
   int i;
-  int frames = (time/frameLength) + 1;
-  nextframe_ = millis() + frameLength;
-  // set speed each servo...
+  moveStart_ = millis();
+  moveTime_ = (time > 0)? time : 0;
+  if(interpolating == 0)
+    nextframe_ = moveStart_ + frameLength;
   for(i=0;i<poseSize;i++){
-    if(nextpose_[i] > pose_[i]){
-      speed_[i] = (nextpose_[i] - pose_[i])/frames + 1;
-    }
-    else{
-      speed_[i] = (pose_[i]-nextpose_[i])/frames + 1;
-    }
+    speed_[i] = nextpose_[i] - pose_[i];
   }
+  left_ = 0x10000;
   interpolating = 1;
 }
-/* interpolate our pose, this should be called at about 30Hz. */
-#define WAIT_SLOP_FACTOR 10  
+/* interpolate our pose, this should be called at least once a frame. */
 int BioloidControllerEx::interpolateStep(boolean fWait){
   if(interpolating == 0) return 0x7fff;
   int i;
-  int complete = poseSize;
+  unsigned long ulNow;
+  unsigned long ulElapsed;
   if (!fWait) {
-    if (millis() < (nextframe_ - WAIT_SLOP_FACTOR)) {
+    if ((long)(millis() - nextframe_) < 0) {
       return (millis() - nextframe_);    // We still have some time to do something... 
     }
   }
-  while(millis() < nextframe_) ;
-  nextframe_ = millis() + frameLength;
-  // update each servo
-  for(i=0;i<poseSize;i++){
-    int diff = nextpose_[i] - pose_[i];
-    if(diff == 0){
-      complete--;
-    }
-    else{
-      if(diff > 0){
-        if(diff < speed_[i]){
-          pose_[i] = nextpose_[i];
-          complete--;
-        }
-        else
-          pose_[i] += speed_[i];
-      }
-      else{
-        if((-diff) < speed_[i]){
-          pose_[i] = nextpose_[i];
-          complete--;
-        }
-        else
-          pose_[i] -= speed_[i];                
-      }       
-    }
-  }
-  if(complete <= 0) interpolating = 0;
+  while((long)(millis() - nextframe_) < 0) ;
+  ulNow = millis();
+  // Frames on a fixed grid, unless we fell more than a frame behind
+  nextframe_ += frameLength;
+  if((long)(ulNow - nextframe_) >= 0)
+    nextframe_ = ulNow + frameLength;
+
+  // What is left of the move, in 1/65536ths.  Each frame moves the servos by
+  // their part of what got done since the last one, so they add up to speed_
+  ulElapsed = ulNow - moveStart_;
+  unsigned long ulLeft = 0;
+  if(ulElapsed < moveTime_)
+    ulLeft = ((unsigned long)(moveTime_ - ulElapsed) << 16) / moveTime_;
+  else
+    interpolating = 0;
+  for(i=0;i<poseSize;i++)
+    pose_[i] += (int)(((long)speed_[i] * (long)left_) >> 16) - (int)(((long)speed_[i] * (long)ulLeft) >> 16);
+  left_ = ulLeft;
+
+  unsigned long ulWrite = micros();
   writePose();      
+  ulWrite = micros() - ulWrite;
+  // Recent max of the write time, decays by 1/16 a frame
+  busTime -= busTime >> 4;
+  if(ulWrite > busTime)
+    busTime = (ulWrite < 0xffff)? ulWrite : 0xffff;
+  if(adaptiveFrame){
+    unsigned long ulFrame = ((unsigned long)busTime * BIOLOID_BUS_SHARE + 999) / 1000;
+    frameLength = (ulFrame < BIOLOID_FRAME_MIN)? BIOLOID_FRAME_MIN : 
+        ((ulFrame > BIOLOID_FRAME_MAX)? BIOLOID_FRAME_MAX : ulFrame);
+  }
   return 0;  
 }
 
+/* how long the caller can be busy before the next frame is due, 
+   rounded down to whole ms (less the one we are in) as that is all nextframe_ has */
+unsigned long BioloidControllerEx::usToNextFrame(){
+  if(interpolating == 0) return 0xffffffff;
+  long lDelta = (long)(nextframe_ - millis()) - 1;
+  return (lDelta > 0)? (unsigned long)lDelta * 1000 : 0;
+}
+
 /* get a servo value in the current pose */
 int BioloidControllerEx::getCurPose(int id){
   for(int i=0; i<poseSize; i++){
@@ -229,5 +234,122 @@ void BioloidControllerEx::play(){
   }
 }
 
+/* ax12GetRegister waits for the answer or times out, so no delay is
+   needed between reads.  One retry covers a reply lost to noise on the bus. */
+int ax12GetRegisterRetry(int id, int regstart, int length){
+  int value = ax12GetRegister(id, regstart, length);
+  if(value < 0)
+    value = ax12GetRegister(id, regstart, length);
+  return value;
+}
 
+/* sync write packet kept between writes: each servo's slot is updated in place and
+   write() sends only the slots that changed, see BioloidEx.h */
+void AX12SyncWrite::setup(unsigned char reg, unsigned char cbData, unsigned char maxServos){
+  if(maxServos > AX12_SYNC_MAX_SLOTS)
+    maxServos = AX12_SYNC_MAX_SLOTS;
+  cbSlot_ = cbData + 1;
+  free(packet_);      // the old-style setup and setup(servo_cnt) both size it
+  packet_ = (unsigned char *) calloc(7 + maxServos * cbSlot_ + 1, 1);
+  if(packet_ == NULL){
+    // no slots, so write() sends nothing and setId/setWord do nothing
+    maxServos_ = 0;
+    cnt_ = 0;
+    changed_ = 0;
+    return;
+  }
+  maxServos_ = maxServos;
+  packet_[0] = 0xFF;
+  packet_[1] = 0xFF;
+  packet_[2] = 0xFE;
+  packet_[4] = AX_SYNC_WRITE;
+  packet_[5] = reg;
+  packet_[6] = cbData;
+  bytesSaved = 0;
+  refresh_ = 0;
+  setCount(maxServos);
+}
+
+void AX12SyncWrite::setCount(unsigned char cnt){
+  if(cnt > maxServos_)
+    cnt = maxServos_;
+  cnt_ = cnt;
+  slotSum_ = 0;
+  for(int i = 7; i < 7 + cnt * cbSlot_; i++)
+    slotSum_ += packet_[i];
+  invalidate();
+}
+
+void AX12SyncWrite::setId(unsigned char index, unsigned char id){
+  if(index >= cnt_)
+    return;
+  unsigned char *pb = &packet_[7 + index * cbSlot_];
+  if(*pb != id){
+    slotSum_ += id - *pb;
+    *pb = id;
+    changed_ |= 1UL << index;
+  }
+}
+
+void AX12SyncWrite::setWord(unsigned char index, unsigned char offset, unsigned int w){
+  if(index >= cnt_)
+    return;
+  unsigned char *pb = &packet_[7 + index * cbSlot_ + 1 + offset];
+  unsigned char bLow = w & 0xff;
+  unsigned char bHigh = w >> 8;
+  if((pb[0] != bLow) || (pb[1] != bHigh)){
+    slotSum_ += (bLow + bHigh) - (pb[0] + pb[1]);
+    pb[0] = bLow;
+    pb[1] = bHigh;
+    changed_ |= 1UL << index;
+  }
+}
+
+unsigned char AX12SyncWrite::write(){
+  unsigned long all = (cnt_ >= 32)? (unsigned long)-1 : ((1UL << cnt_) - 1);
+  unsigned char cnt = 0;
+  unsigned char sum;
+  unsigned char i;
 
+  if(refresh_ == 0){
+    refresh_ = BIOLOID_FULL_REFRESH;
+    changed_ = all;
+  }
+  refresh_--;
+  changed_ &= all;
+  if(changed_ == 0)
+    return 0;
+  for(i = 0; i < cnt_; i++)
+    if(changed_ & (1UL << i))
+      cnt++;
+
+  packet_[3] = 4 + cnt * cbSlot_;
+  sum = 0xFE + packet_[3] + AX_SYNC_WRITE + packet_[5] + packet_[6];
+  setTXall();
+  if(changed_ == all){
+    // Every servo, the packet is ready as it is
+    unsigned char *pbChecksum = &packet_[7 + cnt_ * cbSlot_];
+    *pbChecksum = 0xff - ((sum + slotSum_) & 0xff);
+    for(unsigned char *pb = packet_; pb <= pbChecksum; pb++)
+      ax12write(*pb);
+  }
+  else{
+    // Only the slots that changed
+    for(i = 0; i < 7; i++)
+      ax12write(packet_[i]);
+    for(i = 0; i < cnt_; i++){
+      if(changed_ & (1UL << i)){
+        unsigned char *pb = &packet_[7 + i * cbSlot_];
+        for(unsigned char cb = cbSlot_; cb; cb--){
+          sum += *pb;
+          ax12write(*pb++);
+        }
+      }
+    }
+    ax12write(0xff - sum);
+    bytesSaved += (cnt_ - cnt) * cbSlot_;
+  }
+  setRX(0);
+  changed_ = 0;
+  return cnt;
+}
@@ -31,9 +31,50 @@
 /* pose engine runs at 30Hz (33ms between frames) 
    recommended values for interpolateSetup are of the form X*BIOLOID_FRAME_LENGTH - 1 */
 #define BIOLOID_FRAME_LENGTH      20
+/* with adaptiveFrame the frame length follows the bus time of writePose, so the sync
+   write takes at most 1/BIOLOID_BUS_SHARE of the frame, within these limits (ms).  It
+   only ever lengthens the frame when the bus is busy, never runs faster than the default */
+#define BIOLOID_FRAME_MIN         BIOLOID_FRAME_LENGTH
+#define BIOLOID_FRAME_MAX         33
+#define BIOLOID_BUS_SHARE         10
 /* we need some extra resolution, use 13 bits, rather than 10, during interpolation */
 #define BIOLOID_SHIFT             3
 
+/* ax12GetRegister, asked once more if the servo does not answer, -1 if it still does not */
+int ax12GetRegisterRetry(int id, int regstart, int length);
+
+/* sync writes between full ones, where every servo is sent (about 1 second at 30Hz) */
+#define BIOLOID_FULL_REFRESH      30
+/* the changed slots of a sync write are kept as bits of an unsigned long */
+#define AX12_SYNC_MAX_SLOTS       32
+
+/** Sync write packet kept from one write to the next.  Each servo has a slot,
+ *  its id and cbData bytes, which is updated in place.  The sum of the slots is
+ *  kept up to date as they change, so the checksum of the whole packet is ready,
+ *  and write() only sends the servos whose slot changed since the last write. **/
+class AX12SyncWrite
+{
+  public:
+    AX12SyncWrite() : packet_(NULL), cnt_(0), maxServos_(0), changed_(0) {}
+    void setup(unsigned char reg, unsigned char cbData, unsigned char maxServos);  // may be called again to resize
+    void setCount(unsigned char cnt);           // servos in the packet, the next write sends all
+    unsigned char count() { return cnt_; }
+    void setId(unsigned char index, unsigned char id);
+    void setWord(unsigned char index, unsigned char offset, unsigned int w);  // data bytes at offset, low byte first
+    void invalidate() { changed_ = (unsigned long)-1; }   // the next write sends all
+    unsigned char write();                      // send the changed slots, returns how many
+    unsigned long bytesSaved;                   // bytes not sent as the slots had not changed
+
+  private:
+    unsigned char * packet_;                    // FF FF FE length SYNC_WRITE reg cbData, the slots, checksum
+    unsigned char cbSlot_;                      // id + cbData
+    unsigned char cnt_;
+    unsigned char maxServos_;
+    unsigned char refresh_;                     // writes until the next full one
+    unsigned int slotSum_;                      // sum of the bytes of all the slots
+    unsigned long changed_;                     // slots changed since the last write
+};
+
 /** a structure to hold transitions **/
 typedef struct{
     unsigned int * pose;    // addr of pose to transition to 
@@ -65,12 +106,15 @@ class BioloidControllerEx
     /* Pose Engine */
     void interpolateSetup(int time);            // calculate speeds for smooth transition
     int interpolateStep(boolean fWait=true);                     // move forward one step in current interpolation  
+    unsigned long usToNextFrame();              // us until interpolateStep is due, 0xffffffff if not interpolating
     unsigned char interpolating;                // are we in an interpolation? 0=No, 1=Yes
     unsigned char runningSeq;                   // are we running a sequence? 0=No, 1=Yes 
     int poseSize;                               // how many servos are in this pose, used by Sync()
     
     // Kurt's Hacks
     uint8_t frameLength;                        // Allow variable frame lengths, to test...
+    unsigned char adaptiveFrame;                // pick frameLength from busTime? 0=No, 1=Yes
+    unsigned int busTime;                       // us writePose took, recent max
 
     /* to interpolate:
      *  bioloid.loadPose(myPose);
@@ -96,13 +140,17 @@ class BioloidControllerEx
   private:  
     unsigned int * pose_;                       // the current pose, updated by Step(), set out by Sync()
     unsigned int * nextpose_;                   // the destination pose, where we put on load
-    int * speed_;                               // speeds for interpolation 
+    int * speed_;                               // distance of the move of each servo, nextpose - pose at interpolateSetup
     unsigned char * id_;                        // servo id for this index
 
 //    unsigned long lastframe_;                   // time last frame was sent out  
     unsigned long nextframe_;                   //    
+    unsigned long moveStart_;                   // millis() of interpolateSetup
+    unsigned int moveTime_;                     // and the time of the move
+    unsigned long left_;                        // of the move as of the last frame, in 1/65536ths
     transition_t * sequence;                    // sequence we are running
     int transitions;                            // how many transitions we have left to load
+    AX12SyncWrite syncWrite_;                   // writePose's sync write of the goal positions
    
 };
 #endif
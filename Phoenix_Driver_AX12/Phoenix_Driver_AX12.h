@@ -28,9 +28,46 @@
 #define VOLTAGE_MAX_TIME_BETWEEN_CALLS 1000    // call at least once per second...
 #define VOLTAGE_TIME_TO_ERROR          3000    // Error out if no valid item is returned in 3 seconds...
 
+// Status return level (0 - ping only, 1 - reads, 2 - everything) and return delay time
+// (2us units) Init sets on the servos - may be overridden in Hex_Cfg.h
+#ifndef cAXReturnLevel
+#define cAXReturnLevel      1       // No status packets for writes
+#endif
+#ifndef cAXReturnDelay
+#define cAXReturnDelay      0       // Answer right away, the default is 250 (500us)
+#endif
+// us a read of cb bytes takes at 1Mbps: 8 bytes out, 6+cb back, plus the return delay
+#define AX12_READ_US(cb)    ((8 + 6 + (cb)) * 10 + cAXReturnDelay * 2)
+
+// Background telemetry (OPT_AX12_TELEMETRY) - may be overridden in Hex_Cfg.h
+#ifndef cAXTelemetryBudget
+#define cAXTelemetryBudget  2000    // us of register reads allowed per interpolation frame
+#endif
+#ifndef cAXTempLimit
+#define cAXTempLimit        65      // C - the AX-12 shuts itself down at 70 by default
+#endif
+#ifndef cAXStallLoad
+#define cAXStallLoad        800     // Present load (of 1023) that counts as working hard
+#endif
+#define cAXStallError       20      // and that many units (~6 degrees) short of the goal
+#define cAXStallSamples     3       // on this many sweeps in a row is a stall
+
+// Hybrid motion (OPT_AX12_HYBRID) - may be overridden in Hex_Cfg.h
+#ifndef cAXHybridTolerance
+#define cAXHybridTolerance  8       // units (~2.3 degrees) off the predicted path before we correct it
+#endif
+#define cAXHybridMinTime    20      // ms that must be left of the move for a correction to be worth it
+
 
 #define USE_BIOLOIDEX            // Use the Bioloid code to control the AX12 servos...
 //#define USE_AX12_SPEED_CONTROL   // Experiment to see if the speed control works well enough...
+#ifdef OPT_AX12_HYBRID
+// The speed control mode, plus corrections from the telemetry's present positions
+#define USE_AX12_SPEED_CONTROL
+#ifndef OPT_AX12_TELEMETRY
+#error OPT_AX12_HYBRID needs OPT_AX12_TELEMETRY defined in the config
+#endif
+#endif
 boolean g_fAXSpeedControl;      // flag to know which way we are doing output...
 #include "BioloidEx.h"
 
@@ -39,6 +76,23 @@ boolean g_fAXSpeedControl;      // flag to know which way we are doing output...
 // Current positions in AX coordinates
 word      g_awCurAXPos[NUMSERVOS];
 word      g_awGoalAXPos[NUMSERVOS];
+AX12SyncWrite g_AXSyncSpeed;      // Goal position and speed of each servo
+#endif
+
+#ifdef OPT_AX12_HYBRID
+// Each servo is predicted to go in a straight line from g_awAXPathFrom, g_awAXPathMs
+// into the move, to g_awAXPathTo at the end of the move.  A keyframe starts all of
+// them at 0, a correction restarts one from where it was read.  g_awGoalAXPos may
+// already have the next keyframe's goals.
+word      g_awAXPathFrom[NUMSERVOS];
+word      g_awAXPathMs[NUMSERVOS];
+word      g_awAXPathTo[NUMSERVOS];
+unsigned long g_ulAXMoveStart;    // millis() the last keyframe went out
+word      g_wAXMoveTime;          // and its move time
+boolean   g_fAXHybridFix;         // corrections in g_AXSyncSpeed not sent yet
+unsigned long g_ulAXHybridKeys;   // keyframes sent
+unsigned long g_ulAXHybridFixes;  // correction writes sent
+word      g_wAXHybridMaxErr;      // most a servo was off its path, since the last H command
 #endif
 
 #ifdef DBGSerial
@@ -93,6 +147,7 @@ static const byte cPinTable[] PROGMEM = {
 // Not sure yet if I will use the controller class or not, but...
 BioloidControllerEx bioloid = BioloidControllerEx(1000000);
 boolean g_fServosFree;    // Are the servos in a free state?
+byte g_bAXReturnLevel = 2;  // Highest status return level of any servo, 2 until Init knows better
 
 
 //============================================================================================
@@ -101,6 +156,10 @@ boolean g_fServosFree;    // Are the servos in a free state?
 #define GPSEQ_EEPROM_START_DATA  0x50 // Reserved room for up to 8 in header...
 #define GPSEQ_EEPROM_SIZE 0x800       // I think we have 2K
 #define GPSEQ_EEPROM_MAX_SEQ 5        // For now this is probably the the max we can probably hold...
+#ifndef GPSEQ_CACHE_SIZE
+#define GPSEQ_CACHE_SIZE 0            // RAM to hold a whole sequence's steps and poses, 0 - read ahead only
+#endif
+#define GPSEQ_PREFETCH_BYTES 8        // EEPROM bytes of the next step to read per GPPlayer call
 
 
 // Not sure if pragma needed or not...
@@ -135,7 +194,53 @@ extern void EEPROMWriteData(word wStart, uint8_t *pv, byte cnt);
 extern void TCSetServoID(byte *psz);
 extern void TCTrackServos();
 extern void SetRegOnAllServos(uint8_t bReg, uint8_t bVal);
+#ifdef USE_AX12_SPEED_CONTROL
+extern word CalculateAX12MoveSpeed(word wCurPos, word wGoalPos, word wTime);
+#endif
+#ifdef OPT_AX12_HYBRID
+extern void AXHybridStart(void);
+extern void AXHybridCheck(byte iServo, word wPos);
+#endif
+
+
+//--------------------------------------------------------------------
+// AXWriteDone - After an ax12SetRegister, wait for the status packet
+// if the servos still send one for writes, so we don't talk over it.
+//--------------------------------------------------------------------
+void AXWriteDone(byte bLevel)
+{
+  if (bLevel >= 2)
+    ax12ReadPacket(6);
+}
 
+//--------------------------------------------------------------------
+// InitAXStatusReturn - Make sure each servo has cAXReturnDelay and
+// cAXReturnLevel.  Both live in the servo's EEPROM, so only write them
+// when they differ, then read them back.  g_bAXReturnLevel ends up the
+// highest level any servo has, a servo that does not answer counts as
+// the default 2.
+//--------------------------------------------------------------------
+void InitAXStatusReturn(void)
+{
+  g_bAXReturnLevel = 0;
+  for (byte i = 0; i < NUMSERVOS; i++) {
+    byte bId = pgm_read_byte(&cPinTable[i]);
+    int iLevel = ax12GetRegisterRetry(bId, AX_RETURN_LEVEL, 1);
+    if ((iLevel >= 0) && (ax12GetRegisterRetry(bId, AX_RETURN_DELAY_TIME, 1) != cAXReturnDelay)) {
+      ax12SetRegister(bId, AX_RETURN_DELAY_TIME, cAXReturnDelay);
+      AXWriteDone(iLevel);
+    }
+    if ((iLevel >= 0) && (iLevel != cAXReturnLevel)) {
+      ax12SetRegister(bId, AX_RETURN_LEVEL, cAXReturnLevel);
+      delay(1);   // it may or may not answer this one, let it finish if it does
+      iLevel = ax12GetRegisterRetry(bId, AX_RETURN_LEVEL, 1);
+    }
+    if ((iLevel < 0) || (iLevel > 2))
+      iLevel = 2;
+    if (iLevel > g_bAXReturnLevel)
+      g_bAXReturnLevel = iLevel;
+  }
+}
 
 //--------------------------------------------------------------------
 //Init
@@ -145,13 +250,24 @@ void ServoDriver::Init(void) {
   //  pinMode(0, OUTPUT);
   g_fServosFree = true;
   bioloid.poseSize = NUMSERVOS;
+  // Answer reads without the default 500us delay and writes not at all, before reading the pose back to back
+  InitAXStatusReturn();
   bioloid.readPose();
 #ifdef cVoltagePin  
   for (byte i=0; i < 8; i++)
     GetBatteryVoltage();  // init the voltage pin
 #endif
 
+#ifdef OPT_AX12_HYBRID
+  g_fAXSpeedControl = true;     // Start out with the hybrid, A switches to the bioloid interpolation
+#else
   g_fAXSpeedControl = false;
+#endif
+#ifdef USE_AX12_SPEED_CONTROL
+  g_AXSyncSpeed.setup(AX_GOAL_POSITION_L, 4, NUMSERVOS);
+  for (byte i = 0; i < NUMSERVOS; i++)
+    g_AXSyncSpeed.setId(i, pgm_read_byte(&cPinTable[i]));
+#endif
 
 #ifdef OPT_GPPLAYER
   _fGPEnabled = true;    // assume we support it.
@@ -165,9 +281,6 @@ void ServoDriver::Init(void) {
   bioloid.setId(FIRSTTURRETPIN+1, cTurretTiltPin);
 #endif
 
-  // Added - try to speed things up later if we do a query...
-  SetRegOnAllServos(AX_RETURN_DELAY_TIME, 0);  // tell servos to give us back their info as quick as they can...
-
 }
 
 
@@ -206,6 +319,11 @@ uint16_t ServoDriver::GetBatteryVoltage(void) {
   // one AtoD operation.  So we will limit when we actually do this to maybe a few times per second.  
   // Also if interpolating, the code will try to only call us when it thinks it won't interfer with timing of interpolation.
   unsigned long ulDeltaTime = millis() - g_ulTimeLastBatteryVoltage;
+#ifdef OPT_AX12_TELEMETRY
+  // The telemetry sweep normally keeps this current for us
+  if ((g_wLastVoltage != 0xffff) && (ulDeltaTime < VOLTAGE_MAX_TIME_BETWEEN_CALLS))
+    return g_wLastVoltage;
+#endif
   if (g_wLastVoltage != 0xffff) {
       if ( (ulDeltaTime < VOLTAGE_MIN_TIME_BETWEEN_CALLS) 
             || (bioloid.interpolating &&  (ulDeltaTime < VOLTAGE_MAX_TIME_BETWEEN_CALLS)))
@@ -230,6 +348,189 @@ uint16_t ServoDriver::GetBatteryVoltage(void) {
 }
 #endif
 
+#ifdef OPT_AX12_TELEMETRY
+//--------------------------------------------------------------------
+// AX12 Telemetry - Round robin reads of the present position, load, 
+// voltage and temperature of each servo, done from BackgroundProcess
+// in the slack before the next interpolation frame and never more than
+// cAXTelemetryBudget us of reads per frame.  The results are kept in 
+// g_aAXTelemetry, where we also look for servos getting hot or stalled.
+//--------------------------------------------------------------------
+#define AXTELE_HOT      0x01    // Temperature at or above cAXTempLimit
+#define AXTELE_STALL    0x02    // Loaded and not getting to its goal
+
+typedef struct {
+  word  wPos;           // present position
+  word  wLoad;          // present load, bit 10 is the direction
+  byte  bVoltage;       // in 10ths of a volt
+  byte  bTemp;          // in degrees C
+  byte  bFlags;         // AXTELE_ flags as of the last sweep
+  byte  bStallCnt;      // sweeps in a row that looked stalled
+  byte  bMissed;        // reads in a row that got no answer
+}
+AXTELEMETRY;
+
+static const byte c_abAXTeleRegs[] PROGMEM = {
+  AX_PRESENT_POSITION_L, AX_PRESENT_LOAD_L, AX_PRESENT_VOLTAGE, AX_PRESENT_TEMPERATURE};
+
+AXTELEMETRY   g_aAXTelemetry[NUMSERVOS];
+byte          g_bAXTeleAlarms;          // AXTELE_ flags seen since the last H command
+byte          g_iAXTeleServo;           // next servo to read
+byte          g_iAXTeleReg;             // and which of c_abAXTeleRegs
+#ifdef OPT_AX12_HYBRID
+byte          g_iAXTeleOther = 1;       // the one besides the position this sweep
+#endif
+word          g_wAXTeleReadUs = AX12_READ_US(2);  // recent max of how long a read takes
+word          g_wAXTeleUsed;            // us of reads so far this frame
+word          g_wAXTeleSweep;           // ms the last full sweep took
+unsigned long g_ulAXTeleFrame;          // millis() this frame's budget started
+unsigned long g_ulAXTeleSweep;          // millis() the current sweep started
+unsigned long g_ulAXTeleReads;          // reads done
+
+//--------------------------------------------------------------------
+// AXTelemetryAlarm - Remember the flag and say so if we are debugging
+//--------------------------------------------------------------------
+void AXTelemetryAlarm(byte iServo, byte bFlag)
+{
+  AXTELEMETRY *pt = &g_aAXTelemetry[iServo];
+  if (pt->bFlags & bFlag)
+    return;   // already told them
+  pt->bFlags |= bFlag;
+  g_bAXTeleAlarms |= bFlag;
+#ifdef DBGSerial
+  if (g_fDebugOutput) {
+    DBGSerial.print(F("AX12 "));
+    DBGSerial.print(pgm_read_byte(&cPinTable[iServo]), DEC);
+    if (bFlag == AXTELE_HOT) {
+      DBGSerial.print(F(" hot "));
+      DBGSerial.println(pt->bTemp, DEC);
+    }
+    else {
+      DBGSerial.print(F(" stalled load "));
+      DBGSerial.println(pt->wLoad & 0x3ff, DEC);
+    }
+  }
+#endif
+}
+
+//--------------------------------------------------------------------
+// AXTelemetryReadNext - Read the next register of the sweep
+//--------------------------------------------------------------------
+void AXTelemetryReadNext(void)
+{
+  byte iServo = g_iAXTeleServo;
+  byte bId = pgm_read_byte(&cPinTable[iServo]);
+  byte bReg = pgm_read_byte(&c_abAXTeleRegs[g_iAXTeleReg]);
+  int iVal = ax12GetRegister(bId, bReg, (bReg < AX_PRESENT_VOLTAGE)? 2 : 1);
+  g_ulAXTeleReads++;
+
+  byte iNextReg = g_iAXTeleReg + 1;
+#ifdef OPT_AX12_HYBRID
+  // The hybrid wants the positions more often, so each servo gets its position
+  // and just one of the others, a different one each sweep
+  if (g_fAXSpeedControl)
+    iNextReg = (g_iAXTeleReg == 0)? g_iAXTeleOther : sizeof(c_abAXTeleRegs);
+#endif
+  if (iNextReg >= sizeof(c_abAXTeleRegs)) {
+    iNextReg = 0;
+    if (++g_iAXTeleServo >= NUMSERVOS) {
+      g_iAXTeleServo = 0;
+      g_wAXTeleSweep = millis() - g_ulAXTeleSweep;
+      g_ulAXTeleSweep = millis();
+#ifdef OPT_AX12_HYBRID
+      if (++g_iAXTeleOther >= sizeof(c_abAXTeleRegs))
+        g_iAXTeleOther = 1;
+#endif
+    }
+  }
+  g_iAXTeleReg = iNextReg;
+
+  AXTELEMETRY *pt = &g_aAXTelemetry[iServo];
+  if (iVal == -1) {
+    if (pt->bMissed != 0xff)
+      pt->bMissed++;
+    return;
+  }
+  pt->bMissed = 0;
+
+  switch (bReg) {
+  case AX_PRESENT_POSITION_L:
+    pt->wPos = iVal;
+#ifdef OPT_AX12_HYBRID
+    AXHybridCheck(iServo, iVal);
+#endif
+    break;
+  case AX_PRESENT_LOAD_L:
+    {
+      // Position was read just before this, so compare it to where we last told it to go
+      int iGoal;
+#ifdef USE_AX12_SPEED_CONTROL
+      if (g_fAXSpeedControl)
+        iGoal = g_awGoalAXPos[iServo];
+      else
+#endif
+        iGoal = bioloid.getCurPose(bId);
+      pt->wLoad = iVal;
+      if (((iVal & 0x3ff) >= cAXStallLoad) && (iGoal != -1) && (abs((int)pt->wPos - iGoal) > cAXStallError)) {
+        if (++pt->bStallCnt >= cAXStallSamples) {
+          pt->bStallCnt = cAXStallSamples;
+          AXTelemetryAlarm(iServo, AXTELE_STALL);
+        }
+      }
+      else {
+        pt->bStallCnt = 0;
+        pt->bFlags &= ~AXTELE_STALL;
+      }
+    }
+    break;
+  case AX_PRESENT_VOLTAGE:
+    pt->bVoltage = iVal;
+#ifndef cVoltagePin
+    g_wLastVoltage = iVal * 10;     // GetBatteryVoltage uses this
+    g_ulTimeLastBatteryVoltage = millis();
+#endif
+    break;
+  case AX_PRESENT_TEMPERATURE:
+    pt->bTemp = iVal;
+    if (iVal >= cAXTempLimit)
+      AXTelemetryAlarm(iServo, AXTELE_HOT);
+    else if (iVal < (cAXTempLimit - 5))   // a little hysteresis
+      pt->bFlags &= ~AXTELE_HOT;
+    break;
+  }
+}
+
+//--------------------------------------------------------------------
+// AXTelemetryPoll - Do as many reads as fit in this frame's budget and
+// before the next interpolation frame is due.  fNewFrame is true when
+// the caller just output one.  When not interpolating the budget is per
+// frameLength ms.
+//--------------------------------------------------------------------
+void AXTelemetryPoll(boolean fNewFrame)
+{
+  if (fNewFrame || ((millis() - g_ulAXTeleFrame) >= bioloid.frameLength)) {
+    g_ulAXTeleFrame = millis();
+    g_wAXTeleUsed = 0;
+  }
+
+  // Only start a read if one as slow as the recent max still fits
+  while (((g_wAXTeleUsed + g_wAXTeleReadUs) <= cAXTelemetryBudget) 
+        && (bioloid.usToNextFrame() >= g_wAXTeleReadUs)) {
+    unsigned long ulRead = micros();
+    AXTelemetryReadNext();
+    ulRead = micros() - ulRead;
+    // A read that timed out counts as the whole budget, so we still try one a frame
+    if (ulRead > cAXTelemetryBudget)
+      ulRead = cAXTelemetryBudget;
+    g_wAXTeleUsed += ulRead;
+    // Recent max of the read time, decays by 1/16 a read
+    g_wAXTeleReadUs -= g_wAXTeleReadUs >> 4;
+    if (ulRead > g_wAXTeleReadUs)
+      g_wAXTeleReadUs = ulRead;
+  }
+}
+#endif
+
 //--------------------------------------------------------------------
 //[GP PLAYER]
 //--------------------------------------------------------------------
@@ -241,6 +542,17 @@ boolean g_fSeqProgmem;
 transition_t *g_ptransCur;    // pointer to our current transisiton...
 
 boolean fRobotUpsideDownGPStart;  // state when we start sequence
+
+// The next step of an EEPROM sequence is read into here while the current
+// one interpolates, from the cache if the whole sequence fit in it.
+EEPROMPoseSeq g_eeppsNext;          // step entry
+word g_awGPNextPose[NUMSERVOS];     // and its pose
+byte g_bGPNextStep;                 // which step, 0xff - none
+byte g_cbGPNextRead;                // bytes of the step entry and pose read so far
+#if GPSEQ_CACHE_SIZE
+byte g_abGPSeqCache[GPSEQ_CACHE_SIZE];  // the steps and poses following g_eepph
+boolean g_fGPSeqCached;
+#endif
 #ifdef USE_PYPOSE_HEADER
 #define CNT_PYPOSE_SEGS (sizeof(PoseList)/sizeof(PoseList[0]))
 #else
@@ -284,6 +596,48 @@ boolean ServoDriver::FIsGPSeqDefined(uint8_t iSeq)
 }
 
 
+//--------------------------------------------------------------------
+// GPReadSeqData - Read from the steps and poses of the current EEPROM
+// sequence, wOffset is from the end of its header.
+//--------------------------------------------------------------------
+void GPReadSeqData(word wOffset, uint8_t *pv, byte cnt)
+{
+#if GPSEQ_CACHE_SIZE
+  if (g_fGPSeqCached && ((wOffset + cnt) <= GPSEQ_CACHE_SIZE)) {
+    memcpy(pv, &g_abGPSeqCache[wOffset], cnt);
+    return;
+  }
+#endif
+  EEPROMReadData(g_wSeqHeaderStart + sizeof(g_eepph) + wOffset, pv, cnt);
+}
+
+//--------------------------------------------------------------------
+// GPPrefetch - Read up to cbMax more bytes of step bStep into 
+// g_eeppsNext and g_awGPNextPose.  Starts over if it had another step.
+//--------------------------------------------------------------------
+void GPPrefetch(byte bStep, byte cbMax)
+{
+  if (bStep != g_bGPNextStep) {
+    g_bGPNextStep = bStep;
+    g_cbGPNextRead = 0;
+  }
+  if (!g_cbGPNextRead) {
+    // Need the step entry to know where its pose is
+    GPReadSeqData(bStep * sizeof(EEPROMPoseSeq), (uint8_t*)&g_eeppsNext, sizeof(g_eeppsNext));
+    g_cbGPNextRead = sizeof(EEPROMPoseSeq);
+  }
+  byte cbPoseRead = g_cbGPNextRead - sizeof(EEPROMPoseSeq);
+  byte cb = NUMSERVOS * sizeof(word) - cbPoseRead;
+  if (cb > cbMax)
+    cb = cbMax;
+  if (cb) {
+    // The poses follow the steps
+    GPReadSeqData((g_eepph.bCntSteps * sizeof(EEPROMPoseSeq)) + (g_eeppsNext.bPoseNum * sizeof(word) * NUMSERVOS) + cbPoseRead, 
+        (uint8_t*)g_awGPNextPose + cbPoseRead, cb);
+    g_cbGPNextRead += cb;
+  }
+}
+
 //--------------------------------------------------------------------
 // Setup to start sequence number...
 //--------------------------------------------------------------------
@@ -304,6 +658,21 @@ void ServoDriver::GPStartSeq(uint8_t iSeq)
   g_bSeqStepNum = 0xff;  // Say that we are not in a step yet...
   _sGPSM = 100;          // assume we are running at standard speed
   fRobotUpsideDownGPStart = g_fRobotUpsideDown;
+
+  if (!g_fSeqProgmem) {
+#if GPSEQ_CACHE_SIZE
+    // If the steps and poses fit, read them all now, not while we are moving
+    word cbSeq = g_eepph.bCntSteps * sizeof(EEPROMPoseSeq) + g_eepph.bCntPoses * sizeof(word) * NUMSERVOS;
+    g_fGPSeqCached = false;
+    if (cbSeq <= GPSEQ_CACHE_SIZE) {
+      for (word ib = 0; ib < cbSeq; ib += 0x80)
+        EEPROMReadData(g_wSeqHeaderStart + sizeof(g_eepph) + ib, &g_abGPSeqCache[ib], min(cbSeq - ib, 0x80));
+      g_fGPSeqCached = true;
+    }
+#endif
+    g_bGPNextStep = 0xff;
+    GPPrefetch(0, 0xff);    // the first step
+  }
 }
 
 //--------------------------------------------------------------------
@@ -314,7 +683,6 @@ static const byte cPinIndexTranslateUpsideDownTable[] PROGMEM = {
 
 void ServoDriver::GPPlayer(void)
 {
-  EEPROMPoseSeq eepps;
   byte bServo;
   word wPosePos;
   byte bServoIndexUpsideDown;
@@ -323,6 +691,12 @@ void ServoDriver::GPPlayer(void)
     // See if we are still interpolating the last step
     if ((g_bSeqStepNum != 0xff) && (bioloid.interpolating)) {
       bioloid.interpolateStep(false);
+      if (!g_fSeqProgmem) {
+        // Meanwhile read some of the next step
+        byte bNext = (_sGPSM >= 0)? g_bSeqStepNum + 1 : g_bSeqStepNum - 1;
+        if (bNext < g_eepph.bCntSteps)
+          GPPrefetch(bNext, GPSEQ_PREFETCH_BYTES);
+      }
       return;
     }
 
@@ -373,13 +747,10 @@ void ServoDriver::GPPlayer(void)
       return;
     }
 #endif
-    // Lets get the sequence information
-    EEPROMReadData(g_wSeqHeaderStart + sizeof(g_eepph) + (g_bSeqStepNum*sizeof(EEPROMPoseSeq)), (uint8_t*)&eepps, sizeof(eepps));
-
-    // Now lets setup to read in the pose information
-    word wEEPromPoseLoc = g_wSeqHeaderStart + sizeof(g_eepph) + (g_eepph.bCntPoses*sizeof(EEPROMPoseSeq)) + (eepps.bPoseNum * sizeof(word) * NUMSERVOS); 
+    // The step should already be read in, unless the speed multiplier changed direction
+    GPPrefetch(g_bSeqStepNum, 0xff);
     for (bServo=0; bServo < NUMSERVOS; bServo++) {
-      EEPROMReadData(wEEPromPoseLoc, (uint8_t*)&wPosePos, sizeof(wPosePos));
+      wPosePos = g_awGPNextPose[bServo];
       if (!fRobotUpsideDownGPStart) {
         bioloid.setNextPoseByIndex(bServo, wPosePos);  // set a servo value by index for next pose
       }
@@ -391,11 +762,10 @@ void ServoDriver::GPPlayer(void)
           bioloid.setNextPoseByIndex(bServoIndexUpsideDown, wPosePos);  
       }        
       //      bioloid.setNextPose(bServo+1,wPosePos);
-      wEEPromPoseLoc += sizeof(word);
     }
 
     // interpolate
-    bioloid.interpolateSetup((((long)eepps.wTime)*100)/abs(_sGPSM));
+    bioloid.interpolateSetup((((long)g_eeppsNext.wTime)*100)/abs(_sGPSM));
   }
 }
 
@@ -477,7 +847,7 @@ void ServoDriver::OutputServoInfoForLeg(byte LegIndex, short sCoxaAngle1, short
       g_awGoalAXPos[FIRSTFEMURPIN+LegIndex] = wFemurSDV;    
       g_awGoalAXPos[FIRSTTIBIAPIN+LegIndex] = wTibiaSDV;    
 #ifdef c4DOF
-      g_awGoalAXTarsPos[FIRSTTARSPIN+LegIndex] = wTarsSDV;    
+      g_awGoalAXPos[FIRSTTARSPIN+LegIndex] = wTarsSDV;    
 #endif
 #endif
     }
@@ -521,6 +891,7 @@ void ServoDriver::OutputServoInfoForLeg(byte LegIndex, short sCoxaAngle1, short
 // The AX-12 manual states this as the 'no load speed' at 12V
 // The Moving Speed control table entry states that 0x3FF = 114rpm
 // and according to Robotis this means 0x212 = 59rpm and anything greater 0x212 is also 59rpm
+// So one speed unit is 0.111rpm = 0.666 deg/s = 2.27 position units per second
 #ifdef USE_AX12_SPEED_CONTROL
 word CalculateAX12MoveSpeed(word wCurPos, word wGoalPos, word wTime)
 {
@@ -536,11 +907,13 @@ word CalculateAX12MoveSpeed(word wCurPos, word wGoalPos, word wTime)
   }
 
   // now we can calculate the desired moving speed
-  // for 59pm the factor is 847.46 which we round to 848
+  // travel in wTime ms is 1000/2.27 = 440 speed units per unit per ms (848 had the
+  // servos there in half the time)
   // we need to use a temporary 32bit integer to prevent overflow
-  factor = (uint32_t) 848 * wTravel;
+  factor = (uint32_t) 440 * wTravel;
 
-  wSpeed = (uint16_t) ( factor / wTime );
+  // round up, a servo a little early is better than one falling further behind each move
+  wSpeed = (uint16_t) ( (factor + wTime - 1) / wTime );
   // if the desired speed exceeds the maximum, we need to adjust
   if (wSpeed > 1023) wSpeed = 1023;
   // we also use a minimum speed of 26 (5% of 530 the max value for 59RPM)
@@ -550,6 +923,68 @@ word CalculateAX12MoveSpeed(word wCurPos, word wGoalPos, word wTime)
 } 
 #endif
 
+#ifdef OPT_AX12_HYBRID
+//==============================================================================
+// Hybrid motion - The speed control mode sends each gait step as one keyframe,
+// the goal and the moving speed that gets each servo there at the end of the
+// move, and leaves the servos to get there on their own.  Loads, the speed's
+// resolution or a move cut short can leave a servo off the straight path it
+// should be on, so as the telemetry reads each present position, a servo more
+// than cAXHybridTolerance off gets a new speed to get from there to the goal
+// in the time left.  Only the corrected servos' slots go out.
+//==============================================================================
+//--------------------------------------------------------------------
+// AXHybridPredict - Where servo iServo should be ulMs into the move
+//--------------------------------------------------------------------
+word AXHybridPredict(byte iServo, unsigned long ulMs)
+{
+  word wFrom = g_awAXPathFrom[iServo];
+  word wFromMs = g_awAXPathMs[iServo];
+  word wGoal = g_awAXPathTo[iServo];
+  if ((ulMs >= g_wAXMoveTime) || (wFromMs >= g_wAXMoveTime))
+    return wGoal;
+  if (ulMs <= wFromMs)
+    return wFrom;
+  return wFrom + ((long)((int)wGoal - (int)wFrom) * (long)(ulMs - wFromMs)) / (long)(g_wAXMoveTime - wFromMs);
+}
+
+//--------------------------------------------------------------------
+// AXHybridStart - The servos are at g_awGoalAXPos and not moving
+//--------------------------------------------------------------------
+void AXHybridStart(void)
+{
+  for (byte i = 0; i < NUMSERVOS; i++) {
+    g_awAXPathFrom[i] = g_awAXPathTo[i] = g_awGoalAXPos[i];
+    g_awAXPathMs[i] = 0;
+  }
+  g_fAXHybridFix = false;
+}
+
+//--------------------------------------------------------------------
+// AXHybridCheck - The telemetry just read wPos from servo iServo, see if
+// it is far enough off its path to correct.  The corrections go out
+// from BackgroundProcess.
+//--------------------------------------------------------------------
+void AXHybridCheck(byte iServo, word wPos)
+{
+  if (!g_fAXSpeedControl || g_fServosFree)
+    return;
+  unsigned long ulMs = millis() - g_ulAXMoveStart;
+  if ((ulMs + cAXHybridMinTime) > g_wAXMoveTime)
+    return;   // too late to do much, the next keyframe will take care of it
+  word wGoal = g_awAXPathTo[iServo];
+  word wErr = abs((int)wPos - (int)AXHybridPredict(iServo, ulMs));
+  if (wErr > g_wAXHybridMaxErr)
+    g_wAXHybridMaxErr = wErr;
+  if ((wErr <= cAXHybridTolerance) || (abs((int)wGoal - (int)wPos) <= cAXHybridTolerance))
+    return;
+  g_awAXPathFrom[iServo] = wPos;
+  g_awAXPathMs[iServo] = ulMs;
+  g_AXSyncSpeed.setWord(iServo, 2, CalculateAX12MoveSpeed(wPos, wGoal, g_wAXMoveTime - ulMs));
+  g_fAXHybridFix = true;
+}
+#endif
+
 //------------------------------------------------------------------------------------------
 //[OutputServoInfoForTurret] Set up the outputse servos associated with an optional turret
 //         the Leg number passed in.  FIRSTTURRETPIN
@@ -608,31 +1043,35 @@ void ServoDriver::CommitServoDriver(word wMoveTime)
   if (ServosEnabled) {
     if (g_fAXSpeedControl) {
 #ifdef USE_AX12_SPEED_CONTROL
-      // Need to first output the header for the Sync Write
-      int length = 4 + (NUMSERVOS * 5);   // 5 = id + pos(2byte) + speed(2 bytes)
-      int checksum = 254 + length + AX_SYNC_WRITE + 4 + AX_GOAL_POSITION_L;
+      // Update the slots of the Sync Write, only the servos that changed go out
       word wSpeed;
-      setTXall();
-      ax12write(0xFF);
-      ax12write(0xFF);
-      ax12write(0xFE);
-      ax12write(length);
-      ax12write(AX_SYNC_WRITE);
-      ax12write(AX_GOAL_POSITION_L);
-      ax12write(4);    // number of bytes per servo (plus the ID...)
+#ifdef OPT_AX12_HYBRID
+      unsigned long ulMs = millis() - g_ulAXMoveStart;
+#endif
       for (int i = 0; i < NUMSERVOS; i++) {
+        g_AXSyncSpeed.setWord(i, 0, g_awGoalAXPos[i]);
+#ifdef OPT_AX12_HYBRID
+        // The last move may not be done, so start from where it should be by now.
+        // One that stays put keeps the speed it has, so its slot does not go out again
+        g_awCurAXPos[i] = AXHybridPredict(i, ulMs);
+        g_awAXPathFrom[i] = g_awCurAXPos[i];
+        g_awAXPathMs[i] = 0;
+        g_awAXPathTo[i] = g_awGoalAXPos[i];
+        if (g_awGoalAXPos[i] == g_awCurAXPos[i])
+          continue;
+#endif
         wSpeed = CalculateAX12MoveSpeed(g_awCurAXPos[i], g_awGoalAXPos[i], wMoveTime);    // What order should we store these values?
-        byte id = pgm_read_byte(&cPinTable[i]);
-        checksum += id + (g_awGoalAXPos[i]&0xff) + (g_awGoalAXPos[i]>>8) + (wSpeed>>8) + (wSpeed & 0xff);
-        ax12write(id);
-        ax12write(g_awGoalAXPos[i]&0xff);
-        ax12write(g_awGoalAXPos[i]>>8);
-        ax12write(wSpeed&0xff);
-        ax12write(wSpeed>>8);
-
+        g_AXSyncSpeed.setWord(i, 2, wSpeed);
       }
-      ax12write(0xff - (checksum % 256));
-      setRX(0);
+#ifdef OPT_AX12_HYBRID
+      g_fAXHybridFix = false;   // the keyframe has the latest of everything
+      if (g_AXSyncSpeed.write())
+        g_ulAXHybridKeys++;
+      g_ulAXMoveStart = millis();
+      g_wAXMoveTime = wMoveTime;
+#else
+      g_AXSyncSpeed.write();
+#endif
 
 #endif
     }
@@ -709,7 +1148,7 @@ void ServoDriver::IdleTime(void)
     g_iIdleLedState = 1 - g_iIdleLedState;
   }
   ax12SetRegister(pgm_read_byte(&cPinTable[g_iIdleServoNum]), AX_LED, g_iIdleLedState);
-  ax12ReadPacket(6);  // get the response...
+  AXWriteDone(g_bAXReturnLevel);  // get the response if there is one...
 
 }
 
@@ -728,9 +1167,14 @@ void MakeSureServosAreOn(void)
 #ifdef USE_AX12_SPEED_CONTROL
     if (g_fAXSpeedControl) {
       for(int i=0;i<NUMSERVOS;i++){
-        g_awGoalAXPos[i] = ax12GetRegister(pgm_read_byte(&cPinTable[i]),AX_PRESENT_POSITION_L,2);
-        delay(25);   
+        int iPos = ax12GetRegisterRetry(pgm_read_byte(&cPinTable[i]),AX_PRESENT_POSITION_L,2);
+        if (iPos >= 0)
+          g_awGoalAXPos[i] = iPos;
       }
+#ifdef OPT_AX12_HYBRID
+      AXHybridStart();
+#endif
+      g_AXSyncSpeed.invalidate();
     }
     else {
       bioloid.readPose();
@@ -751,14 +1195,30 @@ void MakeSureServosAreOn(void)
 //==============================================================================
 void  ServoDriver::BackgroundProcess(void) 
 {
-  if (g_fAXSpeedControl) 
-    return;  // nothing to do in this mode...
+  if (g_fAXSpeedControl) {
+#ifdef OPT_AX12_TELEMETRY
+    if (ServosEnabled)
+      AXTelemetryPoll(false);   // No frames to stay out of the way of
+#endif
+#ifdef OPT_AX12_HYBRID
+    if (g_fAXHybridFix) {
+      g_fAXHybridFix = false;
+      if (g_AXSyncSpeed.write())
+        g_ulAXHybridFixes++;
+    }
+#endif
+    return;  // nothing else to do in this mode...
+  }
 
   if (ServosEnabled) {
     DebugToggle(A3);
 
     int iTimeToNextInterpolate = bioloid.interpolateStep(false);    // Do our background stuff...
     
+#ifdef OPT_AX12_TELEMETRY
+    // Reads voltage as part of its sweep.
+    AXTelemetryPoll(iTimeToNextInterpolate == 0);
+#else
     // Hack if we are not interpolating, maybe try to get voltage.  This will acutally only do this
     // a few times per second.
 #ifdef cTurnOffVol          // only do if we a turn off voltage is defined
@@ -766,6 +1226,7 @@ void  ServoDriver::BackgroundProcess(void)
     if (iTimeToNextInterpolate > VOLTAGE_MIN_TIME_UNTIL_NEXT_INTERPOLATE )      // At least 4ms until next interpolation.  See how this works...
         GetBatteryVoltage();
 #endif    
+#endif
 #endif
   }
 }
@@ -780,11 +1241,14 @@ void ServoDriver::ShowTerminalCommandList(void)
 {
   DBGSerial.println(F("V - Voltage"));
   DBGSerial.println(F("M - Toggle Motors on or off"));
-  DBGSerial.println(F("F<frame length> - FL in ms"));    // BUGBUG:: 
+  DBGSerial.println(F("F<frame length> - FL in ms, 0 - from bus time"));    // BUGBUG:: 
   DBGSerial.println(F("A - Toggle AX12 speed control"));
   DBGSerial.println(F("T - Test Servos"));
   DBGSerial.println(F("I - Set Id <frm> <to"));
   DBGSerial.println(F("S - Track Servos"));
+#ifdef OPT_AX12_TELEMETRY
+  DBGSerial.println(F("H - AX12 telemetry"));
+#endif
 #ifdef OPT_PYPOSE
   DBGSerial.println(F("P<DL PC> - Pypose"));
 #endif
@@ -830,6 +1294,45 @@ boolean ServoDriver::ProcessTerminalCommand(byte *psz, byte bLen)
       delay(25);   
     }
   }
+#ifdef OPT_AX12_TELEMETRY
+  if ((bLen == 1) && ((*psz == 'h') || (*psz == 'H'))) {
+    DBGSerial.println(F("ID Pos Load V Temp Missed Flags"));
+    for (byte i = 0; i < NUMSERVOS; i++) {
+      AXTELEMETRY *pt = &g_aAXTelemetry[i];
+      DBGSerial.print(pgm_read_byte(&cPinTable[i]), DEC);
+      DBGSerial.print(F(" "));
+      DBGSerial.print(pt->wPos, DEC);
+      DBGSerial.print((pt->wLoad & 0x400)? F(" -") : F(" "));
+      DBGSerial.print(pt->wLoad & 0x3ff, DEC);
+      DBGSerial.print(F(" "));
+      DBGSerial.print(pt->bVoltage, DEC);
+      DBGSerial.print(F(" "));
+      DBGSerial.print(pt->bTemp, DEC);
+      DBGSerial.print(F(" "));
+      DBGSerial.print(pt->bMissed, DEC);
+      DBGSerial.print((pt->bFlags & AXTELE_HOT)? F(" HOT") : F(""));
+      DBGSerial.println((pt->bFlags & AXTELE_STALL)? F(" STALL") : F(""));
+    }
+    DBGSerial.print(F("Reads: "));
+    DBGSerial.print(g_ulAXTeleReads, DEC);
+    DBGSerial.print(F(" at "));
+    DBGSerial.print(g_wAXTeleReadUs, DEC);
+    DBGSerial.print(F("us, sweep "));
+    DBGSerial.print(g_wAXTeleSweep, DEC);
+    DBGSerial.print(F("ms, alarms since last H: "));
+    DBGSerial.println(g_bAXTeleAlarms, HEX);
+    g_bAXTeleAlarms = 0;
+#ifdef OPT_AX12_HYBRID
+    DBGSerial.print(F("Hybrid keyframes: "));
+    DBGSerial.print(g_ulAXHybridKeys, DEC);
+    DBGSerial.print(F(" corrections: "));
+    DBGSerial.print(g_ulAXHybridFixes, DEC);
+    DBGSerial.print(F(" max off path: "));
+    DBGSerial.println(g_wAXHybridMaxErr, DEC);
+    g_wAXHybridMaxErr = 0;
+#endif
+  }
+#endif
   if ((*psz == 'i') || (*psz == 'I')) {
     TCSetServoID(++psz);
   }
@@ -839,10 +1342,27 @@ boolean ServoDriver::ProcessTerminalCommand(byte *psz, byte bLen)
 
   if ((bLen == 1) && ((*psz == 'a') || (*psz == 'A'))) {
     g_fAXSpeedControl = !g_fAXSpeedControl;
-    if (g_fAXSpeedControl) 
+    if (g_fAXSpeedControl) {
+#ifdef OPT_AX12_HYBRID
+      // Pick up where the interpolation left them
+      for (byte i = 0; i < NUMSERVOS; i++) {
+        int iPos = bioloid.getCurPose(pgm_read_byte(&cPinTable[i]));
+        if (iPos != -1)
+          g_awGoalAXPos[i] = iPos;
+      }
+      AXHybridStart();
+      g_AXSyncSpeed.invalidate();
+      DBGSerial.println(F("AX12 Hybrid Speed Control"));
+#else
       DBGSerial.println(F("AX12 Speed Control"));
-    else
+#endif
+    }
+    else {
+#ifdef OPT_AX12_HYBRID
+      bioloid.readPose();     // the interpolation picks up from where the servos got to
+#endif
       DBGSerial.println(F("Bioloid Speed"));
+    }
   }
   if ((bLen >= 1) && ((*psz == 'f') || (*psz == 'F'))) {
     psz++;  // need to get beyond the first character
@@ -852,12 +1372,19 @@ boolean ServoDriver::ProcessTerminalCommand(byte *psz, byte bLen)
     while ((*psz >= '0') && (*psz <= '9')) {  // Get the frame count...
       bFrame = bFrame*10 + *psz++ - '0';
     }
+    extern BioloidControllerEx bioloid;
+    bioloid.adaptiveFrame = (bFrame == 0);
     if (bFrame != 0) {
       DBGSerial.print(F("New Servo Cycles per second: "));
       DBGSerial.println(1000/bFrame, DEC);
-      extern BioloidControllerEx bioloid;
       bioloid.frameLength = bFrame;
     }
+    else {
+      DBGSerial.print(F("Frame length from bus time "));
+      DBGSerial.print(bioloid.busTime, DEC);
+      DBGSerial.print(F("us: "));
+      DBGSerial.println(bioloid.frameLength, DEC);
+    }
   } 
 
 #ifdef OPT_FIND_SERVO_OFFSETS
@@ -884,7 +1411,14 @@ void TCSetServoID(byte *psz)
     DBGSerial.print(" ");
     DBGSerial.print(wTo, DEC);
     ax12SetRegister(wFrom, AX_ID, wTo);
-    if (ax12ReadPacket(6)) { // get the response...    
+    if (g_bAXReturnLevel < 2) {
+      // No answer to writes, so ask the new id
+      if (ax12GetRegister(wTo, AX_ID, 1) == (int)wTo)
+        DBGSerial.println(" done");
+      else
+        DBGSerial.println(" failed");
+    }
+    else if (ax12ReadPacket(6)) { // get the response...    
       DBGSerial.print(" Resp: ");
       DBGSerial.println(ax_rx_buffer[4], DEC);
     } 
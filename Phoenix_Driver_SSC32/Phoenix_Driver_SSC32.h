@@ -48,6 +48,136 @@ SoftwareSerial SSCSerial(cSSC_IN, cSSC_OUT);
 
 // definition of some helper functions
 extern int SSCRead (byte* pb, int cb, word wTimeout, word wEOL);
+#ifdef OPT_SSC_ASYNC_QUERY
+extern void SSCQueryStart(byte bWhat, byte cbWant, word wTimeout, word wEOL);
+#endif
+extern void SSCSetPrefix(byte iServo, byte bPin);
+
+//------------------------------------------------------------------------------------------
+//[SSC FRAME BUFFER] The group move is built up in g_abSSCFrame by BeginServoUpdate and
+//         OutputServoInfoForLeg and sent with one write by CommitServoDriver, so the
+//         controller interrupts are only held off for that one write.
+//         The servos are numbered LegIndex*cSSCServosPerLeg + joint (Coxa, Femur, Tibia, Tars).
+//------------------------------------------------------------------------------------------
+#ifdef c4DOF
+#define cSSCServosPerLeg  4
+#else
+#define cSSCServosPerLeg  3
+#endif
+#define cSSCServoCnt      (CNT_LEGS*cSSCServosPerLeg)
+#ifdef cSSC_BINARYMODE
+#define cSSCBytesPerServo 3         // pin+0x80, PW high, PW low
+#define cSSCBytesCommit   3         // 0xA1, time high, time low
+#else
+#define cSSCBytesPerServo 8         // #<pin>P<pw> - #31P2500
+#define cSSCBytesCommit   8         // T<time><CR><LF> - T65535
+#endif
+#define cSSCFrameSize     (cSSCServoCnt*cSSCBytesPerServo + cSSCBytesCommit)
+
+byte    g_abSSCFrame[cSSCFrameSize];
+word    g_cbSSCFrame;               // Bytes in the frame being built
+word    g_cbSSCFrameLast;           // Bytes sent by the last CommitServoDriver
+
+// What goes in front of each servo's PW, built by Init: count, then "#<pin>P" or pin+0x80
+#define cSSCPrefixSize    5
+byte    g_abSSCPrefix[cSSCServoCnt][cSSCPrefixSize];
+
+//------------------------------------------------------------------------------------------
+//[SSC DELTA MOVES] With OPT_SSC_DELTA_MOVES only the servos whose pulse width moved more
+//         than cSSCDeltaMin from what was last sent to that pin go into the group move.
+//         Every cSSCFullRefresh frames, after the servos were freed, after a GP sequence
+//         or a terminal command that talks to the SSC-32, all of them are sent again.
+//------------------------------------------------------------------------------------------
+#ifdef OPT_SSC_DELTA_MOVES
+#ifndef cSSCDeltaMin
+#define cSSCDeltaMin      0         // Send when the PW changed by more than this (us)
+#endif
+#ifndef cSSCFullRefresh
+#define cSSCFullRefresh   50        // Send all servos every so many frames
+#endif
+word    g_awSSCLastPW[cSSCServoCnt]; // Last PW sent to each servo
+byte    g_bSSCRefreshCnt;           // Frames left until the next full frame, 0 - this one is
+boolean g_fSSCFullFrame;            // Is the frame being built a full one
+unsigned long g_ulSSCBytesSaved;    // Bytes not sent because of unchanged servos
+
+#define SSCForceFullFrame()   (g_bSSCRefreshCnt = 0)
+#else
+#define SSCForceFullFrame()
+#endif
+
+//------------------------------------------------------------------------------------------
+//[SSC QUERIES] With OPT_SSC_ASYNC_QUERY the GP player queries do not wait for the answer.
+//         The command is sent and SSCQueryStart arms the query, BackgroundProcess collects
+//         the answer as it arrives and acts on it once it is complete or timed out.
+//------------------------------------------------------------------------------------------
+#ifdef OPT_SSC_ASYNC_QUERY
+#ifndef OPT_BACKGROUND_PROCESS
+#error OPT_SSC_ASYNC_QUERY needs OPT_BACKGROUND_PROCESS defined in the config
+#endif
+// Query states
+#define cSSCQIdle         0
+#define cSSCQBusy         1
+#define cSSCQDone         2
+#define cSSCQTimeout      3
+
+// What the query is for
+#define cSSCQGPProbe      0         // Init - does the SSC-32 have the GP player
+#define cSSCQGPStatus     1         // GPPlayer - QPL0 status of the running sequence
+
+byte    g_bSSCQState;               // One of the states above
+byte    g_bSSCQWhat;                // What the query is for
+byte    g_abSSCQReply[4];           // The answer
+byte    g_cbSSCQReply;              // bytes of it received so far
+byte    g_cbSSCQWant;               // bytes expected
+word    g_wSSCQEOL;                 // or until this character
+word    g_wSSCQTimeout;             // max us between characters
+unsigned long g_ulSSCQLastChar;     // micros() of the command or the last character
+#endif
+
+//------------------------------------------------------------------------------------------
+//[SSC TX RING] With OPT_SSC_TX_RING CommitServoDriver puts the group move in a ring of
+//         cSSCTxRingSize bytes instead of writing it to SSCSerial, which blocks once its
+//         TX buffer is full.  BackgroundProcess moves as much as fits in the TX buffer
+//         from the ring to SSCSerial, whose interrupt sends it, so the loop computes the
+//         next move while this one goes out.  Anything else sent to the SSC-32 waits for
+//         the ring to drain first (SSCTxFlush).  Needs a hardware serial port with
+//         availableForWrite (Arduino 1.6.6 or later).
+//------------------------------------------------------------------------------------------
+#ifdef OPT_SSC_TX_RING
+#ifndef OPT_BACKGROUND_PROCESS
+#error OPT_SSC_TX_RING needs OPT_BACKGROUND_PROCESS defined in the config
+#endif
+#if defined(__AVR__) && !defined(UBRR1H) && (cSSC_IN != 0)
+// SSCSerial is the SoftwareSerial above, whose availableForWrite is always 0, so the ring would never drain
+#error OPT_SSC_TX_RING needs the SSC-32 on a hardware serial port
+#endif
+#ifndef cSSCTxRingSize
+#define cSSCTxRingSize    256       // must be a power of 2 and hold at least one group move
+#endif
+#if (cSSCTxRingSize & (cSSCTxRingSize - 1))
+#error cSSCTxRingSize must be a power of 2
+#endif
+// SSCTxQueue would wait forever for room for a group move larger than the ring.
+// CNT_LEGS is an enum, so #if can not check it: the array size goes negative instead.
+typedef char SSCTxRingHoldsAGroupMove[(cSSCFrameSize <= cSSCTxRingSize)? 1 : -1];
+#ifdef SERIAL_TX_BUFFER_SIZE
+#define cSSCTxHWBuffer    SERIAL_TX_BUFFER_SIZE
+#else
+#define cSSCTxHWBuffer    64        // HardwareSerial TX buffer
+#endif
+
+byte    g_abSSCTxRing[cSSCTxRingSize];
+word    g_iSSCTxHead;               // Next byte to queue
+word    g_iSSCTxTail;               // Next byte to hand to SSCSerial
+word    g_cbSSCTxQueuedMax;         // Most bytes ever waiting in the ring
+word    g_cSSCTxStalls;             // Commits that had to wait for room in the ring
+
+#define SSCTxQueued()     ((word)(g_iSSCTxHead - g_iSSCTxTail))
+extern void SSCTxPump(void);
+extern void SSCTxFlush(void);
+#else
+#define SSCTxFlush()
+#endif
 
 
 //--------------------------------------------------------------------
@@ -56,10 +186,22 @@ extern int SSCRead (byte* pb, int cb, word wTimeout, word wEOL);
 void ServoDriver::Init(void) {
   SSCSerial.begin(cSSC_BAUD);
 
+  // Build the per servo prefixes of the group move
+  for (byte LegIndex = 0; LegIndex < CNT_LEGS; LegIndex++) {
+    SSCSetPrefix(LegIndex*cSSCServosPerLeg, pgm_read_byte(&cCoxaPin[LegIndex]));
+    SSCSetPrefix(LegIndex*cSSCServosPerLeg+1, pgm_read_byte(&cFemurPin[LegIndex]));
+    SSCSetPrefix(LegIndex*cSSCServosPerLeg+2, pgm_read_byte(&cTibiaPin[LegIndex]));
+#ifdef c4DOF
+    SSCSetPrefix(LegIndex*cSSCServosPerLeg+3, pgm_read_byte(&cTarsPin[LegIndex]));
+#endif
+  }
+
   // Lets do the check for GP Enabled here...
 #ifdef OPT_GPPLAYER
+#ifndef OPT_SSC_ASYNC_QUERY
   char abT[4];        // give a nice large buffer.
   byte cbRead;
+#endif
 
   _fGPEnabled = false;  // starts off assuming that it is not enabled...
   _fGPActive = false;
@@ -74,6 +216,10 @@ void ServoDriver::Init(void) {
   // Instead of hard checking version numbers instead ask it for
   // status of one of the players.  If we do not get a response...
   // probably does not support 
+#ifdef OPT_SSC_ASYNC_QUERY
+  SSCQueryStart(cSSCQGPProbe, 4, 25000, (word)-1);  // BackgroundProcess sets _fGPEnabled
+  SSCSerial.println(F("QPL0"));
+#else
   SSCSerial.println(F("QPL0"));
   cbRead = SSCRead((byte*)abT, 4, 25000, (word)-1);
 
@@ -86,6 +232,7 @@ void ServoDriver::Init(void) {
   else
     MSound (2, 40, 2500, 40, 2500);
 #endif
+#endif
 #ifdef cVoltagePin
   // Prime the voltage values...
   for (byte i=0; i < 8; i++)
@@ -153,6 +300,105 @@ int SSCRead (byte* pb, int cb, word wTimeout, word wEOL)
   return (int)(pb-pbIn);
 }
 
+#ifdef OPT_SSC_TX_RING
+//==============================================================================
+// SSCTxPump - Hand SSCSerial as many bytes from the ring as fit in its TX buffer.
+//==============================================================================
+void SSCTxPump(void)
+{
+  int cb = SSCSerial.availableForWrite();
+
+  if ((cb <= 0) || !SSCTxQueued())
+    return;
+  g_InputController.AllowControllerInterrupts(false);    // If on xbee on hserial tell hserial to not processess...
+  while (cb-- && SSCTxQueued())
+    SSCSerial.write(g_abSSCTxRing[g_iSSCTxTail++ & (cSSCTxRingSize-1)]);
+  g_InputController.AllowControllerInterrupts(true);    
+}
+
+//==============================================================================
+// SSCTxQueue - Add bytes to the ring, waits for room if the ring is full.
+//==============================================================================
+void SSCTxQueue(const byte *pb, word cb)
+{
+  if ((word)(cSSCTxRingSize - SSCTxQueued()) < cb) {
+    g_cSSCTxStalls++;
+    while ((word)(cSSCTxRingSize - SSCTxQueued()) < cb)
+      SSCTxPump();
+  }
+  while (cb--)
+    g_abSSCTxRing[g_iSSCTxHead++ & (cSSCTxRingSize-1)] = *pb++;
+  if (SSCTxQueued() > g_cbSSCTxQueuedMax)
+    g_cbSSCTxQueuedMax = SSCTxQueued();
+  SSCTxPump();
+}
+
+//==============================================================================
+// SSCTxFlush - Wait until everything in the ring was handed to SSCSerial, so
+//     what is printed next goes out after it.
+//==============================================================================
+void SSCTxFlush(void)
+{
+  while (SSCTxQueued())
+    SSCTxPump();
+}
+
+//==============================================================================
+// SSCTxInFlight - bytes in SSCSerial's TX buffer.  SSCTxUsToDrain - how long
+//     until the ring and the TX buffer are empty.
+//==============================================================================
+word SSCTxInFlight(void)
+{
+  int cb = (cSSCTxHWBuffer - 1) - SSCSerial.availableForWrite();
+  return (cb > 0)? cb : 0;
+}
+
+unsigned long SSCTxUsToDrain(void)
+{
+  return (unsigned long)(SSCTxQueued() + SSCTxInFlight()) * (10000000L / cSSC_BAUD);   // 10 bits per byte
+}
+#endif
+
+#ifdef OPT_SSC_ASYNC_QUERY
+//==============================================================================
+// SSCQueryStart - Arm a query, call it before sending the command.  Throws away
+//     anything left over from an earlier query that timed out.
+//==============================================================================
+void SSCQueryStart(byte bWhat, byte cbWant, word wTimeout, word wEOL)
+{
+  while (SSCSerial.read() != -1)
+    ;
+  g_bSSCQWhat = bWhat;
+  g_cbSSCQReply = 0;
+  g_cbSSCQWant = (cbWant < sizeof(g_abSSCQReply))? cbWant : sizeof(g_abSSCQReply);
+  g_wSSCQEOL = wEOL;
+  g_wSSCQTimeout = wTimeout;
+  g_ulSSCQLastChar = micros();
+  g_bSSCQState = cSSCQBusy;
+}
+
+//==============================================================================
+// SSCQueryPoll - Take what has arrived of the answer, returns the query state.
+//==============================================================================
+byte SSCQueryPoll(void)
+{
+  int ich;
+
+  if (g_bSSCQState != cSSCQBusy)
+    return g_bSSCQState;
+
+  while ((ich = SSCSerial.read()) != -1) {
+    g_abSSCQReply[g_cbSSCQReply++] = (byte)ich;
+    g_ulSSCQLastChar = micros();
+    if ((g_cbSSCQReply == g_cbSSCQWant) || ((word)ich == g_wSSCQEOL))
+      return (g_bSSCQState = cSSCQDone);
+  }
+  if ((micros()-g_ulSSCQLastChar) > g_wSSCQTimeout)    // unsigned long, a word would wrap after 65ms
+    g_bSSCQState = cSSCQTimeout;
+  return g_bSSCQState;
+}
+#endif
+
 
 
 //--------------------------------------------------------------------
@@ -170,10 +416,11 @@ boolean ServoDriver::FIsGPSeqDefined(uint8_t iSeq)
   word wGPSeqPtr;
 
   // See if we can see if this sequence is defined
+  SSCTxFlush();
   SSCSerial.print(F("EER -"));
   SSCSerial.print(iSeq*2, DEC);
   SSCSerial.println(F(";2"));
-  if ((SSCRead((byte*)&wGPSeqPtr, sizeof(wGPSeqPtr), 1000, 0xffff) == sizeof(wGPSeqPtr)) && (wGPSeqPtr != 0)  && (wGPSeqPtr != 0xffff)) {
+  if ((SSCRead((byte*)&wGPSeqPtr, sizeof(wGPSeqPtr), 10000, 0xffff) == sizeof(wGPSeqPtr)) && (wGPSeqPtr != 0)  && (wGPSeqPtr != 0xffff)) {
     return true;
   }
   return false;  // nope return error
@@ -188,6 +435,7 @@ void ServoDriver::GPStartSeq(uint8_t iSeq)
   if (!_fGPActive && (iSeq != 0xff)) {
     _fGPActive = true;
     _iSeq = iSeq;
+    SSCForceFullFrame();    // The sequence moves the servos behind our back
     g_bGPCntSteps = 0xff;
     g_fGPSMChanged = false;
   }
@@ -204,8 +452,10 @@ void ServoDriver::GPPlayer(void)
 {
   byte abStat[4];
   byte cbRead;
+  boolean fStat;
 
   if (_fGPActive) {
+    SSCTxFlush();
     if (g_bGPCntSteps == 0xff) {
       // We have not init yet...
       g_bGPCntSteps = GPNumSteps();  // so get the number of steps.
@@ -222,30 +472,53 @@ void ServoDriver::GPPlayer(void)
         while (SSCSerial.read() != -1)    // remove anything that was queued up.
           ;
         g_InputController.AllowControllerInterrupts(true);    
+#ifdef OPT_SSC_ASYNC_QUERY
+        g_bSSCQState = cSSCQIdle;         // No status yet
+#endif
       }
     }
     else {
       // Player was started up, so lets see what the state is...
+#ifdef OPT_SSC_ASYNC_QUERY
+      if ((_iSeq != 0xff) && (SSCQueryPoll() == cSSCQBusy))
+        return;   // Still waiting for the answer to the last QPL0
+#endif
       g_InputController.AllowControllerInterrupts(false);   
       if (_iSeq == 0xff) {  // User told us to abort
         SSCSerial.println(F("PL0"));
         _fGPActive=false;
       }
       else {
+#ifdef OPT_SSC_ASYNC_QUERY
+        // Use the answer to the QPL0 sent last time, if we got one
+        fStat = (g_bSSCQWhat == cSSCQGPStatus) && (g_bSSCQState == cSSCQDone) && (g_cbSSCQReply == sizeof(abStat));
+        memcpy(abStat, g_abSSCQReply, sizeof(abStat));
+#else
         SSCSerial.print(F("QPL0\r"));
         cbRead = SSCRead((byte*)abStat, sizeof(abStat), 10000, (word)-1);  //    [GPStatSeq, GPStatFromStep, GPStatToStep, GPStatTime]
+        fStat = true;
+#endif
 
-        g_bGPCurStep = abStat[1];
-        if ((g_bGPCurStep == (g_bGPCntSteps-1)) && (abStat[3] == 0)) {
-          // We are done 
-          SSCSerial.println(F("PL0"));
-          _fGPActive=false;
+        if (fStat) {
+          g_bGPCurStep = abStat[1];
+          if ((g_bGPCurStep == (g_bGPCntSteps-1)) && (abStat[3] == 0)) {
+            // We are done 
+            SSCSerial.println(F("PL0"));
+            _fGPActive=false;
+          }
+          else if (g_fGPSMChanged) {
+            g_fGPSMChanged = false;
+            SSCSerial.print(F("PL0SM"));
+            SSCSerial.println(_sGPSM, DEC);
+          }
         }
-        else if (g_fGPSMChanged) {
-          g_fGPSMChanged = false;
-          SSCSerial.print(F("PL0SM"));
-          SSCSerial.println(_sGPSM, DEC);
+#ifdef OPT_SSC_ASYNC_QUERY
+        if (_fGPActive) {
+          // Ask for the next status, the answer is picked up on a later call
+          SSCQueryStart(cSSCQGPStatus, sizeof(abStat), 10000, (word)-1);  //    [GPStatSeq, GPStatFromStep, GPStatToStep, GPStatTime]
+          SSCSerial.print(F("QPL0\r"));
         }
+#endif
       }
       g_InputController.AllowControllerInterrupts(true);    // Ok to process hserial again...
     }
@@ -263,7 +536,7 @@ uint8_t ServoDriver::GPNumSteps(void)          // How many steps does the curren
 
   // Output command to ssc
   SSCSerial.print(F("EER -"));
-  SSCSerial.print(_iSeq, DEC);
+  SSCSerial.print(_iSeq*2, DEC);
   SSCSerial.println(F(";2"));
   cbRead = SSCRead((byte*)&wSeqStart, sizeof(wSeqStart), 10000, (word)-1);  // Try to get the pointer to sequence
 
@@ -273,7 +546,7 @@ uint8_t ServoDriver::GPNumSteps(void)          // How many steps does the curren
     SSCSerial.print(F("EER -"));
     SSCSerial.print(wSeqStart, DEC);
     SSCSerial.println(F(";1"));
-    cbRead = SSCRead((byte*)bGPCntSteps, sizeof(bGPCntSteps), 10000, (word)-1);  // Try to get the pointer to sequence
+    cbRead = SSCRead((byte*)&bGPCntSteps, sizeof(bGPCntSteps), 10000, (word)-1);  // Try to get the pointer to sequence
   }
   return bGPCntSteps;
 }
@@ -298,11 +571,114 @@ void ServoDriver::GPSetSpeedMultiplyer(short sm)      // Set the Speed multiplie
 
 #endif // OPT_GPPLAYER
 
+//--------------------------------------------------------------------
+// Write a number in decimal at pb, returns the end.
+//--------------------------------------------------------------------
+byte *SSCEncodeDec(byte *pb, word w)
+{
+  byte abDigits[5];
+  byte cDigits = 0;
+
+  do {
+    abDigits[cDigits++] = '0' + (w % 10);
+    w /= 10;
+  } 
+  while (w);
+  while (cDigits)
+    *pb++ = abDigits[--cDigits];
+  return pb;
+}
+
+//--------------------------------------------------------------------
+// Write a pulse width in decimal at pb, returns the end.  The PWs are
+// 3 or 4 digits, so do those by subtraction, no divides.
+//--------------------------------------------------------------------
+byte *SSCEncodePW(byte *pb, word w)
+{
+  byte b;
+
+  if ((w < 100) || (w > 9999))
+    return SSCEncodeDec(pb, w);
+  if (w >= 1000) {
+    for (b = '0'; w >= 1000; b++)
+      w -= 1000;
+    *pb++ = b;
+  }
+  for (b = '0'; w >= 100; b++)
+    w -= 100;
+  *pb++ = b;
+  for (b = '0'; w >= 10; b++)
+    w -= 10;
+  *pb++ = b;
+  *pb++ = '0' + w;
+  return pb;
+}
+
+//--------------------------------------------------------------------
+// Build the prefix of one servo from its SSC-32 pin.
+//--------------------------------------------------------------------
+void SSCSetPrefix(byte iServo, byte bPin)
+{
+  byte *pb = &g_abSSCPrefix[iServo][1];
+
+#ifdef cSSC_BINARYMODE
+  *pb++ = bPin + 0x80;
+#else
+  *pb++ = '#';
+  pb = SSCEncodeDec(pb, bPin);
+  *pb++ = 'P';
+#endif
+  g_abSSCPrefix[iServo][0] = pb - &g_abSSCPrefix[iServo][1];
+}
+
+//--------------------------------------------------------------------
+// Append one servo of the group move to the frame.
+//--------------------------------------------------------------------
+void SSCFrameServoFormat(byte iServo, word wSSCV)
+{
+  byte *pbPrefix = g_abSSCPrefix[iServo];
+  byte *pb = &g_abSSCFrame[g_cbSSCFrame];
+  byte cb = *pbPrefix++;
+
+  while (cb--)
+    *pb++ = *pbPrefix++;
+#ifdef cSSC_BINARYMODE
+  *pb++ = wSSCV >> 8;
+  *pb++ = wSSCV & 0xff;
+#else
+  pb = SSCEncodePW(pb, wSSCV);
+#endif
+  g_cbSSCFrame = pb - g_abSSCFrame;
+}
+
+void SSCFrameServo(byte iServo, word wSSCV)
+{
+#ifdef OPT_SSC_DELTA_MOVES
+  if (!g_fSSCFullFrame && (abs((int)wSSCV - (int)g_awSSCLastPW[iServo]) <= cSSCDeltaMin)) {
+    // Leave it out, format it anyway to count the bytes saved
+    word cbFrame = g_cbSSCFrame;
+    SSCFrameServoFormat(iServo, wSSCV);
+    g_ulSSCBytesSaved += g_cbSSCFrame - cbFrame;
+    g_cbSSCFrame = cbFrame;
+    return;
+  }
+  g_awSSCLastPW[iServo] = wSSCV;
+#endif
+  SSCFrameServoFormat(iServo, wSSCV);
+}
+
 //------------------------------------------------------------------------------------------
 //[BeginServoUpdate] Does whatever preperation that is needed to starrt a move of our servos
 //------------------------------------------------------------------------------------------
 void ServoDriver::BeginServoUpdate(void)    // Start the update 
 {
+  g_cbSSCFrame = 0;
+#ifdef OPT_SSC_DELTA_MOVES
+  g_fSSCFullFrame = !g_bSSCRefreshCnt;
+  if (g_fSSCFullFrame)
+    g_bSSCRefreshCnt = cSSCFullRefresh;
+  g_bSSCRefreshCnt--;
+#endif
 }
 
 //------------------------------------------------------------------------------------------
@@ -334,46 +710,15 @@ void ServoDriver::OutputServoInfoForLeg(byte LegIndex, short sCoxaAngle1, short
   wTarsSSCV = ((long)(sTarsAngle1+900))*1000/cPwmDiv+cPFConst;
 #endif
 
-#ifdef cSSC_BINARYMODE
-  SSCSerial.write(pgm_read_byte(&cCoxaPin[LegIndex])  + 0x80);
-  SSCSerial.write(wCoxaSSCV >> 8);
-  SSCSerial.write(wCoxaSSCV & 0xff);
-  SSCSerial.write(pgm_read_byte(&cFemurPin[LegIndex]) + 0x80);
-  SSCSerial.write(wFemurSSCV >> 8);
-  SSCSerial.write(wFemurSSCV & 0xff);
-  SSCSerial.write(pgm_read_byte(&cTibiaPin[LegIndex]) + 0x80);
-  SSCSerial.write(wTibiaSSCV >> 8);
-  SSCSerial.write(wTibiaSSCV & 0xff);
+  byte iServo = LegIndex*cSSCServosPerLeg;
+  SSCFrameServo(iServo, wCoxaSSCV);
+  SSCFrameServo(iServo+1, wFemurSSCV);
+  SSCFrameServo(iServo+2, wTibiaSSCV);
 #ifdef c4DOF
   if ((byte)pgm_read_byte(&cTarsLength[LegIndex])) {    // We allow mix of 3 and 4 DOF legs...
-    SSCSerial.write(pgm_read_byte(&cTarsPin[LegIndex]) + 0x80);
-    SSCSerial.write(wTarsSSCV >> 8);
-    SSCSerial.write(wTarsSSCV & 0xff);
+    SSCFrameServo(iServo+3, wTarsSSCV);
   }
 #endif
-#else
-  SSCSerial.print("#");
-  SSCSerial.print(pgm_read_byte(&cCoxaPin[LegIndex]), DEC);
-  SSCSerial.print("P");
-  SSCSerial.print(wCoxaSSCV, DEC);
-  SSCSerial.print("#");
-  SSCSerial.print(pgm_read_byte(&cFemurPin[LegIndex]), DEC);
-  SSCSerial.print("P");
-  SSCSerial.print(wFemurSSCV, DEC);
-  SSCSerial.print("#");
-  SSCSerial.print(pgm_read_byte(&cTibiaPin[LegIndex]), DEC);
-  SSCSerial.print("P");
-  SSCSerial.print(wTibiaSSCV, DEC);
-#ifdef c4DOF
-  if ((byte)pgm_read_byte(&cTarsLength[LegIndex])) {
-    SSCSerial.print("#");
-    SSCSerial.print(pgm_read_byte(&cTarsPin[LegIndex]), DEC);
-    SSCSerial.print("P");
-    SSCSerial.print(wTarsSSCV, DEC);
-  }
-#endif
-#endif        
-  g_InputController.AllowControllerInterrupts(true);    // Ok for hserial again...
 }
 
 
@@ -385,25 +730,40 @@ void ServoDriver::OutputServoInfoForLeg(byte LegIndex, short sCoxaAngle1, short
 //--------------------------------------------------------------------
 void ServoDriver::CommitServoDriver(word wMoveTime)
 {
-#ifdef cSSC_BINARYMODE
-  byte    abOut[3];
+#ifdef OPT_SSC_DELTA_MOVES
+  boolean fServos = (g_cbSSCFrame != 0);
 #endif
-
-  g_InputController.AllowControllerInterrupts(false);    // If on xbee on hserial tell hserial to not processess...
-
 #ifdef cSSC_BINARYMODE
-  abOut[0] = 0xA1;
-  abOut[1] = wMoveTime >> 8;
-  abOut[2] = wMoveTime & 0xff;
-  SSCSerial.write(abOut, 3);
+  g_abSSCFrame[g_cbSSCFrame++] = 0xA1;
+  g_abSSCFrame[g_cbSSCFrame++] = wMoveTime >> 8;
+  g_abSSCFrame[g_cbSSCFrame++] = wMoveTime & 0xff;
 #else
   //Send <CR>
-  SSCSerial.print("T");
-  SSCSerial.println(wMoveTime, DEC);
+  g_abSSCFrame[g_cbSSCFrame++] = 'T';
+  g_cbSSCFrame = SSCEncodeDec(&g_abSSCFrame[g_cbSSCFrame], wMoveTime) - g_abSSCFrame;
+  g_abSSCFrame[g_cbSSCFrame++] = '\r';
+  g_abSSCFrame[g_cbSSCFrame++] = '\n';
 #endif
 
+#ifdef OPT_SSC_DELTA_MOVES
+  if (!fServos) {
+    // None of the servos changed, nothing to move.
+    g_ulSSCBytesSaved += g_cbSSCFrame;
+    g_cbSSCFrameLast = 0;
+    g_cbSSCFrame = 0;
+    return;
+  }
+#endif
+#ifdef OPT_SSC_TX_RING
+  SSCTxQueue(g_abSSCFrame, g_cbSSCFrame);
+#else
+  g_InputController.AllowControllerInterrupts(false);    // If on xbee on hserial tell hserial to not processess...
+  SSCSerial.write(g_abSSCFrame, g_cbSSCFrame);
   g_InputController.AllowControllerInterrupts(true);    
+#endif
 
+  g_cbSSCFrameLast = g_cbSSCFrame;
+  g_cbSSCFrame = 0;
 }
 
 //--------------------------------------------------------------------
@@ -411,6 +771,7 @@ void ServoDriver::CommitServoDriver(word wMoveTime)
 //--------------------------------------------------------------------
 void ServoDriver::FreeServos(void)
 {
+  SSCTxFlush();
   g_InputController.AllowControllerInterrupts(false);    // If on xbee on hserial tell hserial to not processess...
   for (byte LegIndex = 0; LegIndex < 32; LegIndex++) {
     SSCSerial.print("#");
@@ -419,6 +780,7 @@ void ServoDriver::FreeServos(void)
   }
   SSCSerial.print("T200\r");
   g_InputController.AllowControllerInterrupts(true);    
+  SSCForceFullFrame();
 }
 
 //--------------------------------------------------------------------
@@ -429,6 +791,36 @@ void ServoDriver::IdleTime(void)
 {
 }
 
+#ifdef OPT_BACKGROUND_PROCESS
+//==============================================================================
+// BackgroundProcess - Allows us to have some background processing for those
+//    servo drivers that need us to do things like polling...
+//==============================================================================
+void  ServoDriver::BackgroundProcess(void) 
+{
+#ifdef OPT_SSC_TX_RING
+  SSCTxPump();
+#endif
+#ifdef OPT_SSC_ASYNC_QUERY
+  byte bState = SSCQueryPoll();
+
+#ifdef OPT_GPPLAYER
+  if ((g_bSSCQWhat == cSSCQGPProbe) && (bState >= cSSCQDone)) {
+    g_bSSCQState = cSSCQIdle;
+#ifdef DBGSerial
+    DBGSerial.print(F("Check GP Enable: "));
+    DBGSerial.println(g_cbSSCQReply, DEC);
+#endif        
+    if ((bState == cSSCQDone) && (g_cbSSCQReply == 4))
+      _fGPEnabled = true;
+    else
+      MSound (2, 40, 2500, 40, 2500);
+  }
+#endif
+#endif
+}
+#endif
+
 #ifdef OPT_TERMINAL_MONITOR  
 extern void FindServoOffsets(void);
 extern void SSCForwarder(void);
@@ -445,6 +837,9 @@ void ServoDriver::ShowTerminalCommandList(void)
 #ifdef OPT_SSC_FORWARDER
   DBGSerial.println(F("S - SSC Forwarder"));
 #endif        
+#ifdef OPT_SSC_TX_RING
+  DBGSerial.println(F("Q - SSC TX ring stats"));
+#endif        
 }
 
 //==============================================================================
@@ -453,16 +848,34 @@ void ServoDriver::ShowTerminalCommandList(void)
 //==============================================================================
 boolean ServoDriver::ProcessTerminalCommand(byte *psz, byte bLen)
 {
+#ifdef OPT_SSC_TX_RING
+  // Before any flush, so it shows what the ring holds while walking
+  if ((bLen == 1) && ((*psz == 'q') || (*psz == 'Q'))) {
+    DBGSerial.print(F("SSC TX queued: "));
+    DBGSerial.print(SSCTxQueued(), DEC);
+    DBGSerial.print(F(" in flight: "));
+    DBGSerial.print(SSCTxInFlight(), DEC);
+    DBGSerial.print(F(" drain us: "));
+    DBGSerial.print(SSCTxUsToDrain(), DEC);
+    DBGSerial.print(F(" max queued: "));
+    DBGSerial.print(g_cbSSCTxQueuedMax, DEC);
+    DBGSerial.print(F(" stalls: "));
+    DBGSerial.println(g_cSSCTxStalls, DEC);
+  }
+#endif
 #ifdef OPT_FIND_SERVO_OFFSETS
   if ((bLen == 1) && ((*psz == 'o') || (*psz == 'O'))) {
+    SSCTxFlush();     // Talks to the SSC-32 directly
     FindServoOffsets();
   }
 #endif
 #ifdef OPT_SSC_FORWARDER
   if ((bLen == 1) && ((*psz == 's') || (*psz == 'S'))) {
+    SSCTxFlush();
     SSCForwarder();
   }
 #endif
+  SSCForceFullFrame();
   return true;	// Currently not using the return value
 
 }
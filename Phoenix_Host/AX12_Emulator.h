@@ -0,0 +1,539 @@
+//====================================================================
+//Project Lynxmotion Phoenix
+//
+// Host build - virtual Dynamixel bus.
+//
+// ax12.cpp runs the ax12 library calls (ax12write, setTX/setRX,
+// ax12ReadPacket, ax12GetRegister...) through this instead of a UART,
+// and it plays the servos on the other end:
+//   - A control table for each servo added with AddServo, with the
+//     AX-12 defaults.
+//   - PING, READ_DATA, WRITE_DATA, SYNC_WRITE and BULK_READ (0x92, as
+//     the MX servos do it - a real AX-12 ignores it, clear fBulkRead
+//     to get that).
+//   - Status packets as the status return level (16) says, after the
+//     return delay time (5, 2us units).
+//   - Goal position moves at the moving speed, so present position
+//     and moving read back as they would.  SetSpeedPct has a servo
+//     make only part of it, as one under load does.
+// Every byte each way takes 10 bit times at the baud, the controller
+// waits for the answers it reads, or the library's timeout if none
+// comes.  Traffic is kept per frame, from one goal position sync write
+// (writePose) to the next, for PrintSummary/PrintFrames.
+//====================================================================
+#ifndef _PHOENIX_HOST_AX12_EMULATOR_H_
+#define _PHOENIX_HOST_AX12_EMULATOR_H_
+#include <Arduino.h>
+#include <ax12.h>
+
+#define AX_BULK_READ          0x92    // MX servos only, not in the Arbotix library
+
+#define cAXEmuIds             32      // servo ids 0-31
+#define cAXEmuRegs            50      // control table size
+#define cAXEmuPacket          160     // longest packet we take
+#define cAXEmuReplies         256     // answer bytes not read yet, power of 2
+#define cAXEmuTimeoutUs       1000    // about what ax12ReadPacket's counting loop takes on a 16MHz AVR
+#define cAXEmuMaxSpeed        2330    // position units per second at moving speed 0 (114 rpm)
+
+// Status packet error bits
+#define AXEMU_ERR_RANGE       0x08
+#define AXEMU_ERR_CHECKSUM    0x10
+#define AXEMU_ERR_INSTRUCTION 0x40
+
+typedef struct _AXEmuServo {
+  boolean     fPresent;
+  uint8_t     abRegs[cAXEmuRegs];
+  uint16_t    wFrom;          // position at nsFrom
+  uint64_t    nsFrom;
+  uint64_t    nsTo;           // when it gets to the goal position
+  uint8_t     bSpeedPct;      // of the moving speed it makes
+} AXEMUSERVO;
+
+typedef struct _AXEmuFrame {
+  uint64_t    nsStart;        // the goal position sync write started
+  uint16_t    cbTx;           // bytes the controller sent
+  uint16_t    cbRx;           // bytes the servos sent
+  uint16_t    cPackets;       // packets the controller sent
+  uint16_t    cReads;         // READ_DATA and BULK_READ
+  uint16_t    cTimeouts;      // reads that got no (whole) answer
+  uint16_t    cCollisions;    // controller sent while a servo was answering
+  uint64_t    nsWire;         // bytes on the wire, both ways
+  uint64_t    nsBusy;         // wire, return delays and timeouts waited
+} AXEMUFRAME;
+
+class AX12Emulator {
+public:
+  AX12Emulator() : ulBaud(1000000), fBulkRead(true), pfCapture(NULL), paFrames(NULL), cFrames(0),
+    ulPackets(0), ulSyncWrites(0), ulReads(0), ulWrites(0), ulBulkReads(0), ulBadPackets(0),
+    ulTimeouts(0), ulCollisions(0), ulTxBytes(0), ulRxBytes(0), _cbPacket(0), _nsPacketStart(0),
+    _fCorrupt(false), _fRx(false), _nsRxOn(0), _nsTxIdle(0), _nsReplyEnd(0), _iReplyHead(0), _iReplyTail(0),
+    _cFramesAlloc(0) {
+    memset(_aServos, 0, sizeof(_aServos));
+    memset(&_frCur, 0, sizeof(_frCur));
+  }
+
+  //--------------------------------------------------------------------
+  // Put a servo on the bus, centred, with the AX-12 defaults.
+  //--------------------------------------------------------------------
+  void AddServo(uint8_t bId) {
+    static const uint8_t c_abDefaults[cAXEmuRegs] = {
+      12, 0, 24, 1, 1, 250, 0, 0, 0xff, 3,      // model 12, version, id, baud 1Mbps, 500us return delay, CW/CCW limits 0-1023
+      0, 70, 60, 140, 0xff, 3, 2, 36, 36, 0,    // temp limit 70, 6-14V, max torque 1023, return level 2, alarms
+      0, 0, 0, 0, 0, 0, 1, 1, 32, 32,           // torque off, LED off, compliance margins and slopes
+      0, 2, 0, 0, 0xff, 3, 0, 2, 0, 0,          // goal 512, moving speed 0 (max), torque limit 1023, present 512
+      0, 0, 120, 35, 0, 0, 0, 0, 32, 0};        // load 0, 12.0V, 35C, not moving, punch 32
+    if (bId >= cAXEmuIds)
+      return;
+    AXEMUSERVO *ps = &_aServos[bId];
+    memcpy(ps->abRegs, c_abDefaults, cAXEmuRegs);
+    ps->abRegs[AX_ID] = bId;
+    ps->fPresent = true;
+    ps->wFrom = 512;
+    ps->nsFrom = ps->nsTo = 0;
+    ps->bSpeedPct = 100;
+  }
+  void RemoveServo(uint8_t bId) {
+    if (bId < cAXEmuIds)
+      _aServos[bId].fPresent = false;
+  }
+
+  //--------------------------------------------------------------------
+  // Set the values that read back from the servo's sensors.
+  //--------------------------------------------------------------------
+  void SetSensors(uint8_t bId, uint16_t wLoad, uint8_t bVoltage, uint8_t bTemp) {
+    if ((bId >= cAXEmuIds) || !_aServos[bId].fPresent)
+      return;
+    uint8_t *pb = _aServos[bId].abRegs;
+    pb[AX_PRESENT_LOAD_L] = wLoad & 0xff;
+    pb[AX_PRESENT_LOAD_L+1] = wLoad >> 8;
+    pb[AX_PRESENT_VOLTAGE] = bVoltage;
+    pb[AX_PRESENT_TEMPERATURE] = bTemp;
+  }
+
+  //--------------------------------------------------------------------
+  // Have the servo make only bPct percent of the speed it is asked for,
+  // from its next goal or speed write.
+  //--------------------------------------------------------------------
+  void SetSpeedPct(uint8_t bId, uint8_t bPct) {
+    if ((bId < cAXEmuIds) && bPct)
+      _aServos[bId].bSpeedPct = bPct;
+  }
+
+  //--------------------------------------------------------------------
+  // Where the servo is at the given time, and where it is going.
+  //--------------------------------------------------------------------
+  uint16_t ServoPos(uint8_t bId, uint64_t ns) {
+    AXEMUSERVO *ps = &_aServos[bId & (cAXEmuIds-1)];
+    uint16_t wGoal = Reg2(ps, AX_GOAL_POSITION_L);
+    if (ns >= ps->nsTo)
+      return (ps->nsTo > ps->nsFrom)? wGoal : ps->wFrom;
+    if (ns <= ps->nsFrom)
+      return ps->wFrom;
+    return ps->wFrom + (int)((int64_t)((int)wGoal - (int)ps->wFrom) * (int64_t)(ns - ps->nsFrom) / (int64_t)(ps->nsTo - ps->nsFrom));
+  }
+  uint16_t ServoGoal(uint8_t bId) {
+    return Reg2(&_aServos[bId & (cAXEmuIds-1)], AX_GOAL_POSITION_L);
+  }
+
+  //--------------------------------------------------------------------
+  // The library side: a byte from the controller (takes a byte time),
+  // direction changes and waiting for an answer.
+  //--------------------------------------------------------------------
+  void Write(uint8_t b) {
+    uint64_t ns = NsNow();
+    if (pfCapture)
+      fputc(b, pfCapture);
+    if (_nsTxIdle > ns)
+      ns = _nsTxIdle;
+    if (_nsReplyEnd > ns) {
+      // A servo is still answering, neither gets through
+      ulCollisions++;
+      _frCur.cCollisions++;
+      _fCorrupt = true;
+      DropReplies();
+    }
+    uint64_t nsByte = NsPerByte();
+    _nsTxIdle = ns + nsByte;
+    g_ulHostMicros = (unsigned long)((_nsTxIdle + 999) / 1000);
+    ulTxBytes++;
+    _frCur.cbTx++;
+    _frCur.nsWire += nsByte;
+    _frCur.nsBusy += nsByte;
+    Receive(b, ns);
+  }
+
+  void SetTX(void) {
+    _fRx = false;
+  }
+  void SetRX(void) {
+    // The library resets its receive buffer here, anything before is lost
+    _fRx = true;
+    _nsRxOn = NsNow();
+    if (_nsTxIdle > _nsRxOn)
+      _nsRxOn = _nsTxIdle;
+    while ((_iReplyHead != _iReplyTail) && (_ansReply[_iReplyTail] <= _nsRxOn))
+      _iReplyTail = (_iReplyTail + 1) & (cAXEmuReplies - 1);
+  }
+
+  //--------------------------------------------------------------------
+  // ax12ReadPacket: wait for cb bytes or the timeout, 1 if the packet's
+  // checksum is good.
+  //--------------------------------------------------------------------
+  int ReadPacket(uint8_t *pb, int cb) {
+    uint64_t ns = NsNow();
+    int cbRead = 0;
+    while (_fRx && (cbRead < cb) && (_iReplyHead != _iReplyTail)) {
+      ns = _ansReply[_iReplyTail];
+      pb[cbRead++] = _abReply[_iReplyTail];
+      _iReplyTail = (_iReplyTail + 1) & (cAXEmuReplies - 1);
+    }
+    if (cbRead < cb) {
+      ulTimeouts++;
+      _frCur.cTimeouts++;
+      _frCur.nsBusy += (uint64_t)cAXEmuTimeoutUs * 1000;
+      ns += (uint64_t)cAXEmuTimeoutUs * 1000;
+    }
+    if (ns > NsNow())
+      g_ulHostMicros = (unsigned long)((ns + 999) / 1000);
+    uint8_t bSum = 0;
+    for (int i = 2; i < cbRead; i++)
+      bSum += pb[i];
+    return (cbRead >= 6) && (bSum == 0xff);
+  }
+
+  //--------------------------------------------------------------------
+  // Reports
+  //--------------------------------------------------------------------
+  void PrintFrames(FILE *pf) {
+    fprintf(pf, "frame,start_us,period_us,tx_bytes,rx_bytes,packets,reads,timeouts,collisions,wire_us,busy_us,busy_pct\n");
+    for (unsigned long i = 0; i < cFrames; i++) {
+      AXEMUFRAME *pfr = &paFrames[i];
+      uint64_t nsPeriod = Period(i);
+      fprintf(pf, "%lu,%llu,%llu,%u,%u,%u,%u,%u,%u,%llu,%llu,%llu\n", i, (unsigned long long)(pfr->nsStart / 1000),
+          (unsigned long long)(nsPeriod / 1000), pfr->cbTx, pfr->cbRx, pfr->cPackets, pfr->cReads, pfr->cTimeouts,
+          pfr->cCollisions, (unsigned long long)(pfr->nsWire / 1000), (unsigned long long)(pfr->nsBusy / 1000),
+          (unsigned long long)(nsPeriod? pfr->nsBusy * 100 / nsPeriod : 0));
+    }
+  }
+
+  void PrintSummary(FILE *pf) {
+    fprintf(pf, "AX-12 bus %lu baud: %lu packets (%lu sync writes, %lu writes, %lu reads, %lu bulk reads), %lu bad\n",
+        ulBaud, ulPackets, ulSyncWrites, ulWrites, ulReads, ulBulkReads, ulBadPackets);
+    fprintf(pf, "  %lu bytes out, %lu back, %lu timeouts, %lu collisions\n", ulTxBytes, ulRxBytes, ulTimeouts, ulCollisions);
+    // Frames that ran into a pause (nothing to interpolate) are left out of the averages
+    unsigned long cCounted = 0, cOver = 0, ulBytes = 0;
+    uint64_t nsBusy = 0, nsBusyMax = 0, nsPeriods = 0, nsPeriodMin = (uint64_t)-1;
+    unsigned uPctMax = 0;
+    for (unsigned long i = 0; i + 1 < cFrames; i++) {
+      AXEMUFRAME *pfr = &paFrames[i];
+      uint64_t nsPeriod = Period(i);
+      if (nsPeriod > 100000000ULL)
+        continue;
+      cCounted++;
+      ulBytes += pfr->cbTx + pfr->cbRx;
+      nsBusy += pfr->nsBusy;
+      nsPeriods += nsPeriod;
+      if (pfr->nsBusy > nsBusyMax)
+        nsBusyMax = pfr->nsBusy;
+      if (nsPeriod < nsPeriodMin)
+        nsPeriodMin = nsPeriod;
+      if (nsPeriod && (pfr->nsBusy * 100 / nsPeriod > uPctMax))
+        uPctMax = pfr->nsBusy * 100 / nsPeriod;
+      if (pfr->nsBusy > nsPeriod)
+        cOver++;
+    }
+    fprintf(pf, "  %lu frames", cFrames);
+    if (cCounted)
+      fprintf(pf, ": bytes/frame avg %lu, bus busy avg %llu max %llu us, %llu%% avg %u%% max of the period (shortest %llu us), over: %lu",
+          ulBytes / cCounted, (unsigned long long)(nsBusy / cCounted / 1000), (unsigned long long)(nsBusyMax / 1000),
+          (unsigned long long)(nsPeriods? nsBusy * 100 / nsPeriods : 0), uPctMax, (unsigned long long)(nsPeriodMin / 1000), cOver);
+    fprintf(pf, "\n");
+  }
+
+  void PrintServos(FILE *pf) {
+    fprintf(pf, "  servo goals:");
+    for (int i = 0; i < cAXEmuIds; i++)
+      if (_aServos[i].fPresent)
+        fprintf(pf, " %d:%u", i, ServoGoal(i));
+    fprintf(pf, "\n");
+  }
+
+  unsigned long   ulBaud;
+  boolean         fBulkRead;          // answer BULK_READ
+  FILE            *pfCapture;         // everything the controller sends
+  AXEMUFRAME      *paFrames;          // one per goal position sync write
+  unsigned long   cFrames;
+  unsigned long   ulPackets;          // from the controller
+  unsigned long   ulSyncWrites;
+  unsigned long   ulReads;
+  unsigned long   ulWrites;
+  unsigned long   ulBulkReads;
+  unsigned long   ulBadPackets;       // checksum, length or instruction we do not do
+  unsigned long   ulTimeouts;
+  unsigned long   ulCollisions;
+  unsigned long   ulTxBytes;
+  unsigned long   ulRxBytes;
+
+private:
+  uint64_t NsNow(void) {
+    return (uint64_t)g_ulHostMicros * 1000;
+  }
+  uint64_t NsPerByte(void) {
+    return ulBaud? 10000000000ULL / ulBaud : 0;
+  }
+  uint64_t Period(unsigned long i) {
+    return (i + 1 < cFrames)? paFrames[i+1].nsStart - paFrames[i].nsStart : 0;
+  }
+  static uint16_t Reg2(AXEMUSERVO *ps, uint8_t bReg) {
+    return ps->abRegs[bReg] | (ps->abRegs[bReg+1] << 8);
+  }
+  void DropReplies(void) {
+    _iReplyTail = _iReplyHead;
+    _nsReplyEnd = 0;
+  }
+
+  //--------------------------------------------------------------------
+  // Packet assembly: 0xff 0xff id length instruction params checksum
+  //--------------------------------------------------------------------
+  void Receive(uint8_t b, uint64_t nsStart) {
+    if (!_cbPacket)
+      _nsPacketStart = nsStart;
+    if ((_cbPacket < 2) && (b != 0xff)) {
+      _cbPacket = 0;            // waiting for the header
+      return;
+    }
+    if ((_cbPacket == 2) && (b == 0xff))
+      return;                   // extra 0xff before the id
+    _abPacket[_cbPacket++] = b;
+    if ((_cbPacket == 4) && ((b < 2) || (b > cAXEmuPacket - 4))) {
+      ulBadPackets++;
+      _cbPacket = 0;
+      return;
+    }
+    if ((_cbPacket < 4) || (_cbPacket < _abPacket[3] + 4))
+      return;
+    _cbPacket = 0;
+    Execute(_nsTxIdle);
+    _fCorrupt = false;
+  }
+
+  //--------------------------------------------------------------------
+  // Whole packet in at ns.
+  //--------------------------------------------------------------------
+  void Execute(uint64_t ns) {
+    uint8_t bId = _abPacket[2];
+    uint8_t cbParams = _abPacket[3] - 2;
+    uint8_t bIns = _abPacket[4];
+    uint8_t *pbParams = &_abPacket[5];
+    uint8_t bSum = 0;
+    for (int i = 2; i < _abPacket[3] + 4; i++)
+      bSum += _abPacket[i];
+
+    ulPackets++;
+    if ((bIns == AX_SYNC_WRITE) && cbParams && (pbParams[0] == AX_GOAL_POSITION_L) && !_fCorrupt && (bSum == 0xff))
+      NewFrame(ns);
+    _frCur.cPackets++;
+    if (_fCorrupt)
+      return;                   // garbled by a collision, nobody understood it
+    if (bSum != 0xff) {
+      ulBadPackets++;
+      Status(bId, AXEMU_ERR_CHECKSUM, NULL, 0, ns, 2);
+      return;
+    }
+
+    switch (bIns) {
+    case AX_PING:
+      Status(bId, 0, NULL, 0, ns, 0);
+      break;
+    case AX_READ_DATA:
+      ulReads++;
+      _frCur.cReads++;
+      if ((cbParams == 2) && (bId < cAXEmuIds) && _aServos[bId].fPresent) {
+        uint8_t ab[cAXEmuRegs];
+        uint8_t bErr = ReadRegs(bId, pbParams[0], pbParams[1], ab, ns);
+        Status(bId, bErr, ab, bErr? 0 : pbParams[1], ns, 1);
+      }
+      break;
+    case AX_WRITE_DATA:
+      ulWrites++;
+      if (cbParams >= 2) {
+        uint8_t bErr = 0;
+        if (bId == 0xfe) {
+          for (int i = 0; i < cAXEmuIds; i++)
+            if (_aServos[i].fPresent)
+              WriteRegs(i, pbParams[0], pbParams + 1, cbParams - 1, ns);
+        }
+        else if ((bId < cAXEmuIds) && _aServos[bId].fPresent) {
+          bErr = WriteRegs(bId, pbParams[0], pbParams + 1, cbParams - 1, ns);
+          Status(bId, bErr, NULL, 0, ns, 2);
+        }
+      }
+      break;
+    case AX_SYNC_WRITE:
+      // reg, cb, then id and cb bytes for each servo
+      ulSyncWrites++;
+      if ((cbParams >= 2) && pbParams[1]) {
+        uint8_t cbSlot = pbParams[1] + 1;
+        for (int i = 2; i + cbSlot <= cbParams; i += cbSlot) {
+          uint8_t bSlotId = pbParams[i];
+          if ((bSlotId < cAXEmuIds) && _aServos[bSlotId].fPresent)
+            WriteRegs(bSlotId, pbParams[0], pbParams + i + 1, pbParams[1], ns);
+        }
+      }
+      break;
+    case AX_BULK_READ:
+      // 0, then length, id, reg for each servo.  Each answers after the one before it
+      // has, so one that is missing holds up the rest, as on the real bus.
+      ulBulkReads++;
+      _frCur.cReads++;
+      if (!fBulkRead) {
+        ulBadPackets++;
+        break;
+      }
+      for (int i = 1; i + 3 <= cbParams; i += 3) {
+        uint8_t bSlotId = pbParams[i+1];
+        if ((bSlotId >= cAXEmuIds) || !_aServos[bSlotId].fPresent)
+          break;
+        uint8_t ab[cAXEmuRegs];
+        uint8_t bErr = ReadRegs(bSlotId, pbParams[i+2], pbParams[i], ab, ns);
+        Status(bSlotId, bErr, ab, bErr? 0 : pbParams[i], (_nsReplyEnd > ns)? _nsReplyEnd : ns, 1);
+      }
+      break;
+    default:
+      ulBadPackets++;
+      Status(bId, AXEMU_ERR_INSTRUCTION, NULL, 0, ns, 2);
+      break;
+    }
+  }
+
+  //--------------------------------------------------------------------
+  // Start a new frame with the packet that just came in.
+  //--------------------------------------------------------------------
+  void NewFrame(uint64_t) {
+    uint16_t cb = _abPacket[3] + 4;
+    uint64_t nsPacket = cb * NsPerByte();
+    AXEMUFRAME fr;
+    memset(&fr, 0, sizeof(fr));
+    fr.nsStart = _nsPacketStart;
+    fr.cbTx = cb;
+    fr.nsWire = fr.nsBusy = nsPacket;
+    _frCur.cbTx -= cb;
+    _frCur.nsWire -= nsPacket;
+    _frCur.nsBusy -= nsPacket;
+    if (_frCur.nsStart) {
+      if (cFrames == _cFramesAlloc) {
+        _cFramesAlloc = _cFramesAlloc? _cFramesAlloc * 2 : 1024;
+        paFrames = (AXEMUFRAME*)realloc(paFrames, _cFramesAlloc * sizeof(AXEMUFRAME));
+      }
+      paFrames[cFrames++] = _frCur;
+    }
+    _frCur = fr;
+  }
+
+  //--------------------------------------------------------------------
+  // Control table access.
+  //--------------------------------------------------------------------
+  uint8_t ReadRegs(uint8_t bId, uint8_t bReg, uint8_t cb, uint8_t *pb, uint64_t ns) {
+    AXEMUSERVO *ps = &_aServos[bId];
+    if (!cb || (bReg + cb > cAXEmuRegs))
+      return AXEMU_ERR_RANGE;
+    uint16_t wPos = ServoPos(bId, ns);
+    ps->abRegs[AX_PRESENT_POSITION_L] = wPos & 0xff;
+    ps->abRegs[AX_PRESENT_POSITION_L+1] = wPos >> 8;
+    ps->abRegs[AX_MOVING] = (ns < ps->nsTo);
+    memcpy(pb, &ps->abRegs[bReg], cb);
+    return 0;
+  }
+
+  uint8_t WriteRegs(uint8_t bId, uint8_t bReg, const uint8_t *pb, uint8_t cb, uint64_t ns) {
+    AXEMUSERVO *ps = &_aServos[bId];
+    if (!cb || (bReg + cb > cAXEmuRegs) || (bReg < AX_ID))
+      return AXEMU_ERR_RANGE;
+    uint16_t wPos = ServoPos(bId, ns);
+    memcpy(&ps->abRegs[bReg], pb, cb);
+    if ((bReg <= AX_TORQUE_ENABLE) && (bReg + cb > AX_TORQUE_ENABLE) && !ps->abRegs[AX_TORQUE_ENABLE]) {
+      // Relaxed, it stays where it is
+      ps->wFrom = wPos;
+      ps->nsFrom = ps->nsTo = ns;
+    }
+    if ((bReg <= AX_GOAL_SPEED_L + 1) && (bReg + cb > AX_GOAL_POSITION_L)) {
+      // New goal or speed, goal writes turn the torque on
+      uint16_t wSpeed = Reg2(ps, AX_GOAL_SPEED_L) & 0x3ff;
+      uint32_t ulRate = wSpeed? (uint32_t)wSpeed * 2271 / 1000 : cAXEmuMaxSpeed;
+      if (!ulRate || (ulRate > cAXEmuMaxSpeed))
+        ulRate = cAXEmuMaxSpeed;
+      ulRate = ulRate * ps->bSpeedPct / 100;
+      if (!ulRate)
+        ulRate = 1;
+      uint16_t wGoal = Reg2(ps, AX_GOAL_POSITION_L);
+      ps->abRegs[AX_TORQUE_ENABLE] = 1;
+      ps->wFrom = wPos;
+      ps->nsFrom = ns;
+      ps->nsTo = ns + (uint64_t)abs((int)wGoal - (int)wPos) * 1000000000ULL / ulRate;
+    }
+    if ((bReg == AX_ID) && (pb[0] != bId) && (pb[0] < cAXEmuIds)) {
+      _aServos[pb[0]] = *ps;
+      ps->fPresent = false;
+    }
+    return 0;
+  }
+
+  //--------------------------------------------------------------------
+  // Queue a status packet from bId if its status return level is at
+  // least bLevel (0 - PING, 1 - reads, 2 - everything).  It starts the
+  // return delay after ns.
+  //--------------------------------------------------------------------
+  void Status(uint8_t bId, uint8_t bErr, const uint8_t *pb, uint8_t cb, uint64_t ns, uint8_t bLevel) {
+    if ((bId >= cAXEmuIds) || !_aServos[bId].fPresent)
+      return;
+    AXEMUSERVO *ps = &_aServos[bId];
+    if ((bLevel > 0) && (ps->abRegs[AX_RETURN_LEVEL] < bLevel))
+      return;
+    uint64_t nsDelay = (uint64_t)ps->abRegs[AX_RETURN_DELAY_TIME] * 2000;
+    uint64_t nsByte = NsPerByte();
+    uint8_t ab[cAXEmuRegs + 6];
+    uint8_t bSum = bId + cb + 2 + bErr;
+    ab[0] = ab[1] = 0xff;
+    ab[2] = bId;
+    ab[3] = cb + 2;
+    ab[4] = bErr;
+    for (int i = 0; i < cb; i++) {
+      ab[5+i] = pb[i];
+      bSum += pb[i];
+    }
+    ab[5+cb] = ~bSum;
+    ns += nsDelay;
+    for (int i = 0; i < cb + 6; i++) {
+      ns += nsByte;
+      _ansReply[_iReplyHead] = ns;
+      _abReply[_iReplyHead] = ab[i];
+      _iReplyHead = (_iReplyHead + 1) & (cAXEmuReplies - 1);
+      if (_iReplyHead == _iReplyTail)
+        _iReplyTail = (_iReplyTail + 1) & (cAXEmuReplies - 1);   // full, drop the oldest
+    }
+    _nsReplyEnd = ns;
+    ulRxBytes += cb + 6;
+    _frCur.cbRx += cb + 6;
+    _frCur.nsWire += (cb + 6) * nsByte;
+    _frCur.nsBusy += nsDelay + (cb + 6) * nsByte;
+  }
+
+  AXEMUSERVO      _aServos[cAXEmuIds];
+  uint8_t         _abPacket[cAXEmuPacket];
+  uint8_t         _cbPacket;
+  uint64_t        _nsPacketStart;
+  boolean         _fCorrupt;          // a collision garbled the packet coming in
+  boolean         _fRx;               // setRX - listening for answers
+  uint64_t        _nsRxOn;
+  uint64_t        _nsTxIdle;          // the controller's last byte is out
+  uint64_t        _nsReplyEnd;        // the last answer byte is in
+  uint64_t        _ansReply[cAXEmuReplies];   // when each answer byte has arrived
+  uint8_t         _abReply[cAXEmuReplies];
+  uint16_t        _iReplyHead;
+  uint16_t        _iReplyTail;
+  AXEMUFRAME      _frCur;             // the frame going on now
+  unsigned long   _cFramesAlloc;
+};
+
+extern AX12Emulator g_AXEmu;          // the bus, in ax12.cpp
+#endif
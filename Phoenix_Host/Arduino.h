@@ -0,0 +1,279 @@
+//====================================================================
+//Project Lynxmotion Phoenix
+//
+// Host (Linux) build - Arduino core stand-ins
+//
+// Just enough of the Arduino core for Phoenix_Code.h, the SSC-32 and
+// AX-12 servo drivers and most of the input controllers to compile
+// with the host g++.  Time is simulated: g_ulHostMicros only moves when
+// the code asks for the time or delays, so loop() runs as fast as the
+// host can execute it while the sketch still sees the same timings.
+//
+// See Phoenix_Host.cpp for how to build a configuration.
+//====================================================================
+#ifndef _PHOENIX_HOST_ARDUINO_H_
+#define _PHOENIX_HOST_ARDUINO_H_
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define ARDUINO 105
+#define PHOENIX_HOST
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#include <avr/pgmspace.h>
+
+#define HIGH    1
+#define LOW     0
+#define OUTPUT  1
+#define INPUT   0
+#define INPUT_PULLUP 2
+#define DEC     10
+#define HEX     16
+#define A0      14
+#define A1      15
+#define A2      16
+#define A3      17
+#define A4      18
+#define A5      19
+
+// Defined so the configs pick the hardware Serial1 for the SSC-32
+// instead of SoftwareSerial.
+#define UBRR1H  1
+
+#ifndef min
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#endif
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+//--------------------------------------------------------------------
+// Simulated time.  Each millis() call costs 2us so that busy waits on
+// millis() terminate, each micros() call costs 1us.
+//--------------------------------------------------------------------
+extern unsigned long g_ulHostMicros;
+inline unsigned long millis(void) {
+  return (g_ulHostMicros += 2) / 1000;
+}
+inline unsigned long micros(void) {
+  return g_ulHostMicros++;
+}
+inline void delay(unsigned long ms) {
+  g_ulHostMicros += ms * 1000;
+}
+inline void delayMicroseconds(unsigned int us) {
+  g_ulHostMicros += us;
+}
+
+//--------------------------------------------------------------------
+// IO pins.  Writes land in g_abHostPorts so that code using the
+// portOutputRegister macros can be checked, analogRead returns the
+// value the test harness put in g_awHostAnalog.
+//--------------------------------------------------------------------
+extern volatile uint32_t g_abHostPorts[16];
+extern uint16_t g_awHostAnalog[8];
+#define digitalPinToPort(p)       ((p) >> 3)
+#define digitalPinToBitMask(p)    (1 << ((p) & 7))
+#define portOutputRegister(port)  (&g_abHostPorts[(port)])
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int pin, int val) {
+  if (val)
+    g_abHostPorts[digitalPinToPort(pin)] |= digitalPinToBitMask(pin);
+  else
+    g_abHostPorts[digitalPinToPort(pin)] &= ~digitalPinToBitMask(pin);
+}
+inline int digitalRead(int pin) {
+  return (g_abHostPorts[digitalPinToPort(pin)] & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+inline int analogRead(int pin) {
+  return g_awHostAnalog[(pin >= A0)? (pin - A0) & 7 : pin & 7];
+}
+inline unsigned long pulseIn(int, int, unsigned long = 1000000L) {
+  return 0;
+}
+inline void tone(int, unsigned int, unsigned long = 0) {}
+inline void noTone(int) {}
+inline void interrupts(void) {}
+inline void noInterrupts(void) {}
+
+//--------------------------------------------------------------------
+// Print / Stream / HardwareSerial.  Output goes to pfCapture if set,
+// input comes from pfFeed if set, otherwise the port is silent.
+//--------------------------------------------------------------------
+class Print {
+public:
+  virtual size_t write(uint8_t b) = 0;
+  virtual int availableForWrite(void) { return 0; }
+  virtual size_t write(const uint8_t *pb, size_t cb) {
+    size_t n = 0;
+    while (cb--)
+      n += write(*pb++);
+    return n;
+  }
+  size_t write(const char *psz) {
+    return write((const uint8_t*)psz, strlen(psz));
+  }
+  size_t print(const char *psz) {
+    return write(psz);
+  }
+  size_t print(char c) {
+    return write((uint8_t)c);
+  }
+  size_t print(long v, int base = DEC) {
+    char sz[34];
+    snprintf(sz, sizeof(sz), (base == HEX)? "%lX" : "%ld", v);
+    return write(sz);
+  }
+  size_t print(unsigned long v, int base = DEC) {
+    char sz[34];
+    snprintf(sz, sizeof(sz), (base == HEX)? "%lX" : "%lu", v);
+    return write(sz);
+  }
+  size_t print(int v, int base = DEC)            { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC)   { return print((unsigned long)v, base); }
+  size_t print(unsigned char v, int base = DEC)  { return print((unsigned long)v, base); }
+  size_t print(short v, int base = DEC)          { return print((long)v, base); }
+  size_t print(unsigned short v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(double v, int digits = 2) {
+    char sz[40];
+    snprintf(sz, sizeof(sz), "%.*f", digits, v);
+    return write(sz);
+  }
+  size_t println(void) {
+    return write("\r\n");
+  }
+  template<class T> size_t println(T v) {
+    size_t n = print(v);
+    return n + println();
+  }
+  template<class T> size_t println(T v, int base) {
+    size_t n = print(v, base);
+    return n + println();
+  }
+};
+
+class Stream : public Print {
+public:
+  Stream() : pfFeed(NULL), iPeek(-1) {}
+  FILE *pfFeed;
+  virtual int available(void) {
+    return (peek() >= 0)? 1 : 0;
+  }
+  virtual int peek(void) {
+    if ((iPeek < 0) && pfFeed)
+      iPeek = fgetc(pfFeed);
+    return iPeek;
+  }
+  virtual int read(void) {
+    int ich = peek();
+    iPeek = -1;
+    return ich;
+  }
+  virtual void flush(void) {}
+  void setTimeout(unsigned long) {}
+  size_t readBytesUntil(char chTerm, char *pb, size_t cb) {
+    size_t n = 0;
+    int ich;
+    while ((n < cb) && ((ich = read()) >= 0) && (ich != chTerm))
+      pb[n++] = (char)ich;
+    return n;
+  }
+  size_t readBytesUntil(char chTerm, uint8_t *pb, size_t cb) {
+    return readBytesUntil(chTerm, (char*)pb, cb);
+  }
+private:
+  int iPeek;
+};
+
+//--------------------------------------------------------------------
+// Something on the other end of a serial port, e.g. the SSC-32
+// emulator.  Times are in simulated ns.
+//--------------------------------------------------------------------
+class HostSerialDevice {
+public:
+  virtual void  HostReceive(uint8_t b, uint64_t nsArrived) = 0;   // byte from the sketch, fully arrived at nsArrived
+  virtual int   HostPeek(uint64_t nsNow) = 0;                     // byte for the sketch, -1 if none has arrived yet
+  virtual int   HostRead(uint64_t nsNow) = 0;
+};
+
+//--------------------------------------------------------------------
+// With a device attached the port keeps the wire time: each byte takes
+// 10 bit times at the begin() baud.  If cbTxBuffer is set, a write
+// blocks (simulated time moves on) while that many bytes are queued.
+//--------------------------------------------------------------------
+#define SERIAL_TX_BUFFER_SIZE 64    // as the AVR core, for availableForWrite without a device
+
+class HardwareSerial : public Stream {
+public:
+  HardwareSerial() : pfCapture(NULL), pDevice(NULL), ulBaud(0), cbTxBuffer(0), nsTxIdle(0) {}
+  FILE *pfCapture;
+  HostSerialDevice *pDevice;
+  unsigned long ulBaud;
+  uint16_t cbTxBuffer;            // TX buffer size, 0 - writes never block
+  uint64_t nsTxIdle;              // when the last byte written will be out
+
+  void begin(unsigned long baud) {
+    ulBaud = baud;
+  }
+  void end(void) {}
+  uint64_t NsPerByte(void) {
+    return ulBaud? 10000000000ULL / ulBaud : 0;
+  }
+  virtual size_t write(uint8_t b) {
+    if (pfCapture)
+      fputc(b, pfCapture);
+    if (pDevice) {
+      uint64_t nsNow = (uint64_t)g_ulHostMicros * 1000;
+      uint64_t nsByte = NsPerByte();
+      if (nsTxIdle < nsNow)
+        nsTxIdle = nsNow;
+      if (cbTxBuffer && (nsTxIdle > nsNow + cbTxBuffer * nsByte))
+        g_ulHostMicros = (unsigned long)((nsTxIdle - cbTxBuffer * nsByte + 999) / 1000);  // wait for room in the buffer
+      nsTxIdle += nsByte;
+      pDevice->HostReceive(b, nsTxIdle);
+    }
+    return 1;
+  }
+  using Print::write;
+  virtual int availableForWrite(void) {
+    if (!pDevice || !cbTxBuffer)
+      return SERIAL_TX_BUFFER_SIZE - 1;
+    uint64_t nsNow = (uint64_t)g_ulHostMicros * 1000;
+    uint64_t nsByte = NsPerByte();
+    long cbQueued = (nsTxIdle > nsNow)? (long)((nsTxIdle - nsNow + nsByte - 1) / nsByte) : 0;
+    if (cbQueued < cbTxBuffer)
+      return cbTxBuffer - cbQueued;
+    g_ulHostMicros++;             // full, so callers spinning on it see time pass
+    return 0;
+  }
+  virtual int peek(void) {
+    if (pDevice)
+      return pDevice->HostPeek((uint64_t)g_ulHostMicros * 1000);
+    return Stream::peek();
+  }
+  virtual int read(void) {
+    if (pDevice)
+      return pDevice->HostRead((uint64_t)g_ulHostMicros * 1000);
+    return Stream::read();
+  }
+  virtual void flush(void) {
+    if (pDevice && (nsTxIdle > (uint64_t)g_ulHostMicros * 1000))
+      g_ulHostMicros = (unsigned long)((nsTxIdle + 999) / 1000);
+  }
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif
@@ -0,0 +1,27 @@
+//====================================================================
+// Host build - EEPROM is a RAM array, erased (0xff) at startup.
+// usRead is what each read costs in simulated time, to play at an I2C
+// EEPROM (about 110us a byte at 400KHz).
+//====================================================================
+#ifndef _PHOENIX_HOST_EEPROM_H_
+#define _PHOENIX_HOST_EEPROM_H_
+#include <Arduino.h>
+
+class EEPROMClass {
+public:
+  EEPROMClass() : usRead(0) {
+    memset(ab, 0xff, sizeof(ab));
+  }
+  uint8_t read(int i) {
+    if (usRead)
+      delayMicroseconds(usRead);
+    return ab[i & (sizeof(ab)-1)];
+  }
+  void write(int i, uint8_t b) {
+    ab[i & (sizeof(ab)-1)] = b;
+  }
+  uint8_t ab[4096];
+  unsigned int usRead;
+};
+extern EEPROMClass EEPROM;
+#endif
@@ -0,0 +1,285 @@
+//====================================================================
+//Project Lynxmotion Phoenix
+//
+// Host build - accuracy and speed of the fixed point math in
+// Phoenix_Code.h, checked against <cmath>.  Run with -b 1, it prints
+// the report and exits without running loop().
+//
+// The routines the new ones replaced are kept here as a reference,
+// so the report compares new, old and <cmath> side by side.  Host
+// times are only a relative measure, the ATmega has no FPU and a
+// 8 bit ALU.
+//====================================================================
+#ifndef _PHOENIX_HOST_BENCH_H_
+#define _PHOENIX_HOST_BENCH_H_
+#include <math.h>
+#include <time.h>
+
+static volatile long g_lBenchSink;      // keeps the timed calls from being optimized away
+
+//--------------------------------------------------------------------
+// Error statistics, in units of the last decimal of the result
+//--------------------------------------------------------------------
+typedef struct _BenchErr {
+  double    dMax;
+  double    dSum;
+  long      lCnt;
+  double    dAtMax;                     // input with the largest error
+}
+BENCHERR;
+
+static void BenchErrAdd(BENCHERR *pErr, double dErr, double dIn)
+{
+  dErr = fabs(dErr);
+  if (dErr > pErr->dMax) {
+    pErr->dMax = dErr;
+    pErr->dAtMax = dIn;
+  }
+  pErr->dSum += dErr;
+  pErr->lCnt++;
+}
+
+static void BenchErrPrint(FILE *pf, const char *pszName, const BENCHERR *pErr)
+{
+  fprintf(pf, "  %-34s max %7.2f (at %g)  mean %6.3f  over %ld\n", pszName,
+      pErr->dMax, pErr->dAtMax, pErr->dSum / pErr->lCnt, pErr->lCnt);
+}
+
+//--------------------------------------------------------------------
+// Host ns per call of the statement, run lLoops times
+//--------------------------------------------------------------------
+#define BENCH_NS(lLoops, stmt) ({ \
+  clock_t clkStart = clock(); \
+  for (long lBench = 0; lBench < (lLoops); lBench++) { stmt; } \
+  (double)(clock() - clkStart) * 1e9 / CLOCKS_PER_SEC / (lLoops); })
+
+//--------------------------------------------------------------------
+// Reference: the 0.5 deg sin table and GetSinCos that SinCos replaced
+//--------------------------------------------------------------------
+static const word g_awBenchOldSin[] = {
+  0, 87, 174, 261, 348, 436, 523, 610, 697, 784, 871, 958, 1045, 1132, 1218, 1305, 1391, 1478, 1564,
+  1650, 1736, 1822, 1908, 1993, 2079, 2164, 2249, 2334, 2419, 2503, 2588, 2672, 2756, 2840, 2923, 3007,
+  3090, 3173, 3255, 3338, 3420, 3502, 3583, 3665, 3746, 3826, 3907, 3987, 4067, 4146, 4226, 4305, 4383,
+  4461, 4539, 4617, 4694, 4771, 4848, 4924, 4999, 5075, 5150, 5224, 5299, 5372, 5446, 5519, 5591, 5664,
+  5735, 5807, 5877, 5948, 6018, 6087, 6156, 6225, 6293, 6360, 6427, 6494, 6560, 6626, 6691, 6755, 6819,
+  6883, 6946, 7009, 7071, 7132, 7193, 7253, 7313, 7372, 7431, 7489, 7547, 7604, 7660, 7716, 7771, 7826,
+  7880, 7933, 7986, 8038, 8090, 8141, 8191, 8241, 8290, 8338, 8386, 8433, 8480, 8526, 8571, 8616, 8660,
+  8703, 8746, 8788, 8829, 8870, 8910, 8949, 8987, 9025, 9063, 9099, 9135, 9170, 9205, 9238, 9271, 9304,
+  9335, 9366, 9396, 9426, 9455, 9483, 9510, 9537, 9563, 9588, 9612, 9636, 9659, 9681, 9702, 9723, 9743,
+  9762, 9781, 9799, 9816, 9832, 9848, 9862, 9876, 9890, 9902, 9914, 9925, 9935, 9945, 9953, 9961, 9969,
+  9975, 9981, 9986, 9990, 9993, 9996, 9998, 9999, 10000 };
+
+static SINCOS4 BenchOldSinCos(short AngleDeg1)
+{
+  SINCOS4 sc;
+  short   ABSAngleDeg1 = (AngleDeg1 < 0)? -AngleDeg1 : AngleDeg1;
+
+  if (AngleDeg1 < 0)
+    AngleDeg1 = 3600-(ABSAngleDeg1-(3600*(ABSAngleDeg1/3600)));
+  else
+    AngleDeg1 = ABSAngleDeg1-(3600*(ABSAngleDeg1/3600));
+
+  if (AngleDeg1>=0 && AngleDeg1<=900) {
+    sc.sin4 = g_awBenchOldSin[AngleDeg1/5];
+    sc.cos4 = g_awBenchOldSin[(900-(AngleDeg1))/5];
+  }
+  else if (AngleDeg1>900 && AngleDeg1<=1800) {
+    sc.sin4 = g_awBenchOldSin[(900-(AngleDeg1-900))/5];
+    sc.cos4 = -g_awBenchOldSin[(AngleDeg1-900)/5];
+  }
+  else if (AngleDeg1>1800 && AngleDeg1<=2700) {
+    sc.sin4 = -g_awBenchOldSin[(AngleDeg1-1800)/5];
+    sc.cos4 = -g_awBenchOldSin[(2700-AngleDeg1)/5];
+  }
+  else {
+    sc.sin4 = -g_awBenchOldSin[(3600-AngleDeg1)/5];
+    sc.cos4 = g_awBenchOldSin[(AngleDeg1-2700)/5];
+  }
+  return sc;
+}
+
+//--------------------------------------------------------------------
+// SinCos over every binary angle and over -720..720 deg in the tenth
+// of a degree steps the callers use, and GetArcCos over its input range
+//--------------------------------------------------------------------
+static void BenchSinCos(FILE *pf)
+{
+  BENCHERR errBin = {0, 0, 0, 0}, errNew = {0, 0, 0, 0}, errOld = {0, 0, 0, 0}, errACos = {0, 0, 0, 0};
+  SINCOS4  sc;
+  long     l;
+
+  fprintf(pf, "SinCos (decimals = 4), error in LSB against sin/cos:\n");
+  for (l = 0; l < 0x10000; l++) {
+    double dRad = l * 2 * M_PI / 65536.0;
+    sc = SinCos((word)l);
+    BenchErrAdd(&errBin, sc.sin4 - sin(dRad) * c4DEC, l);
+    BenchErrAdd(&errBin, sc.cos4 - cos(dRad) * c4DEC, l);
+  }
+  for (l = -7200; l <= 7200; l++) {
+    double dRad = l * M_PI / 1800.0;
+    sc = SinCos(AngleDeg1ToBin(l));
+    BenchErrAdd(&errNew, sc.sin4 - sin(dRad) * c4DEC, l);
+    BenchErrAdd(&errNew, sc.cos4 - cos(dRad) * c4DEC, l);
+    sc = BenchOldSinCos(l);
+    BenchErrAdd(&errOld, sc.sin4 - sin(dRad) * c4DEC, l);
+    BenchErrAdd(&errOld, sc.cos4 - cos(dRad) * c4DEC, l);
+  }
+  BenchErrPrint(pf, "SinCos, all binary angles", &errBin);
+  BenchErrPrint(pf, "SinCos(AngleDeg1ToBin), deg1", &errNew);
+  BenchErrPrint(pf, "old GetSinCos, deg1", &errOld);
+
+  fprintf(pf, "GetArcCos (decimals = 4), error in LSB against acos:\n");
+  for (l = -c4DEC; l <= c4DEC; l++)
+    BenchErrAdd(&errACos, GetArcCos(l) - acos(l / (double)c4DEC) * c4DEC, l);
+  BenchErrPrint(pf, "GetArcCos, cos4", &errACos);
+
+  const long lLoops = 20000000;
+  fprintf(pf, "Host ns per call:\n");
+  fprintf(pf, "  SinCos(AngleDeg1ToBin) %6.2f\n", BENCH_NS(lLoops,
+      sc = SinCos(AngleDeg1ToBin((short)(lBench & 0x1fff) - 4096)); g_lBenchSink += sc.sin4 + sc.cos4));
+  fprintf(pf, "  old GetSinCos          %6.2f\n", BENCH_NS(lLoops,
+      sc = BenchOldSinCos((short)(lBench & 0x1fff) - 4096); g_lBenchSink += sc.sin4 + sc.cos4));
+  fprintf(pf, "  sin + cos <cmath>      %6.2f\n", BENCH_NS(lLoops,
+      double dRad = ((lBench & 0x1fff) - 4096) * M_PI / 1800.0; g_lBenchSink += (long)(sin(dRad) * c4DEC) + (long)(cos(dRad) * c4DEC)));
+  fprintf(pf, "  GetArcCos              %6.2f\n", BENCH_NS(lLoops,
+      g_lBenchSink += GetArcCos((short)(lBench % 20001) - c4DEC)));
+}
+
+//--------------------------------------------------------------------
+// Reference: the isqrt32 + divide + GetArcCos GetATan2 that ATan2Hyp
+// replaced.  Returns the angle, the hypotenuse in *plHyp2
+//--------------------------------------------------------------------
+static short BenchOldATan2(short AtanX, short AtanY, long *plHyp2)
+{
+  long XYhyp2 = isqrt32(((long)AtanX*AtanX*c4DEC) + ((long)AtanY*AtanY*c4DEC));
+  short AngleRad4 = GetArcCos(((long)AtanX*(long)c6DEC) /(long) XYhyp2);
+  *plHyp2 = XYhyp2;
+  return (AtanY < 0)? -AngleRad4 : AngleRad4;
+}
+
+//--------------------------------------------------------------------
+// ATmega cycle estimate.  There is no AVR compiler or simulator in the
+// host build, so this counts the operations each version executes and
+// prices them with the usual avr-gcc -Os / libgcc costs on a part with
+// MUL, call and return included.  Good to tell 500 from 2000 cycles,
+// not to a few percent.
+//--------------------------------------------------------------------
+#define cAvrMulHiSi     25      // __mulhisi3, short * short -> long
+#define cAvrMulSi       45      // __mulsi3, long * long
+#define cAvrDivSi       650     // __divmodsi4, long / long bit loop
+#define cAvrDivHi       210     // __divmodhi4, short / short bit loop
+#define cAvrLong        4       // add, sub, compare or move of a long
+#define cAvrPgmWord     7       // pgm_read_word
+#define cAvrVarShift    7       // per bit of a long shifted by a variable count (loop)
+
+// A long shifted by a constant: byte moves for the whole bytes, 4 cycles a bit for the rest
+static long BenchAvrConstShift(int iBits)
+{
+  if (!iBits)
+    return 0;
+  return cAvrLong + ((iBits >= 8)? 6 : 0) + 4 * (iBits & 7);
+}
+
+static long BenchAvrOldATan2(short AtanX, short AtanY)
+{
+  uint32_t n = (uint32_t)((long)AtanX*AtanX*c4DEC) + (uint32_t)((long)AtanY*AtanY*c4DEC);
+  uint32_t root = 0, place = 0x40000000;
+  long lCycles = 2 * (cAvrMulHiSi + cAvrMulSi) + cAvrLong;
+  short cos4;
+
+  // isqrt32
+  while (place > n) {
+    place >>= 2;
+    lCycles += cAvrLong + BenchAvrConstShift(2) + 2;
+  }
+  while (place) {
+    lCycles += 3 * cAvrLong + 2 + 1 + BenchAvrConstShift(1) + BenchAvrConstShift(2);
+    if (n >= root + place) {
+      n -= root + place;
+      root += place << 1;
+      lCycles += 3 * cAvrLong + BenchAvrConstShift(1);
+    }
+    root >>= 1;
+    place >>= 2;
+  }
+  // cos = x / hyp, then GetArcCos
+  lCycles += cAvrMulHiSi + cAvrDivSi;
+  cos4 = ((long)AtanX*(long)c6DEC) / (long)root;
+  if (cos4 < 0)
+    cos4 = -cos4;
+  lCycles += 20;                                       // sign, min and range tests
+  if (cos4 < 9000)
+    lCycles += cAvrDivHi;                              // cos4/79, the others are shifts
+  lCycles += 5 + cAvrMulHiSi + cAvrDivSi + 6;          // table, *616/c1DEC, sign
+  return lCycles;
+}
+
+static long BenchAvrATan2Hyp(boolean fVarShift)
+{
+  long lCycles = 2 * cAvrMulHiSi + 12 + cAvrLong + BenchAvrConstShift(8);
+  for (int i = 0; i < (int)(sizeof(GetATanCordic)/sizeof(GetATanCordic[0])); i++) {
+    lCycles += cAvrLong + 2 + 2 * cAvrLong + cAvrPgmWord + 2 + cAvrLong;
+    if (fVarShift)
+      lCycles += 2 * (3 + cAvrVarShift * i) + 6;       // two shift loops, loop counter
+    else
+      lCycles += 2 * BenchAvrConstShift(i);
+  }
+  return lCycles;
+}
+
+//--------------------------------------------------------------------
+// ATan2Hyp against atan2/hypot and the old GetATan2 over the X/Y range
+// LegIK and the balance code use
+//--------------------------------------------------------------------
+static void BenchATan2Hyp(FILE *pf)
+{
+  BENCHERR   errAng = {0, 0, 0, 0}, errHyp = {0, 0, 0, 0}, errOldAng = {0, 0, 0, 0}, errOldHyp = {0, 0, 0, 0};
+  ATAN2HYP4  ah;
+  long       lHyp2, lOldMax = 0, lOldSum = 0, lCnt = 0;
+  short      x, y;
+
+  for (x = -400; x <= 400; x++)
+    for (y = -400; y <= 400; y++) {
+      if (!x && !y)
+        continue;
+      double dAng = atan2(y, x) * c4DEC, dHyp = hypot(x, y) * c2DEC;
+      ah = ATan2Hyp(x, y);
+      BenchErrAdd(&errAng, ah.Atan4 - dAng, x * 1000 + y);
+      BenchErrAdd(&errHyp, ah.Hyp2 - dHyp, x * 1000 + y);
+      BenchErrAdd(&errOldAng, BenchOldATan2(x, y, &lHyp2) - dAng, x * 1000 + y);
+      BenchErrAdd(&errOldHyp, lHyp2 - dHyp, x * 1000 + y);
+      long lCycles = BenchAvrOldATan2(x, y);
+      lOldMax = max(lOldMax, lCycles);
+      lOldSum += lCycles;
+      lCnt++;
+    }
+  fprintf(pf, "ATan2Hyp, error in LSB against atan2 (decimals = 4) and hypot (decimals = 2), x,y -400..400 (at x*1000+y):\n");
+  BenchErrPrint(pf, "ATan2Hyp angle", &errAng);
+  BenchErrPrint(pf, "ATan2Hyp hypotenuse", &errHyp);
+  BenchErrPrint(pf, "old GetATan2 angle", &errOldAng);
+  BenchErrPrint(pf, "old GetATan2 hypotenuse", &errOldHyp);
+
+  const long lLoops = 20000000;
+  fprintf(pf, "Host ns per call:\n");
+  fprintf(pf, "  ATan2Hyp               %6.2f\n", BENCH_NS(lLoops,
+      ah = ATan2Hyp((short)((lBench & 0xff) * 2 - 255), (short)(((lBench >> 8) & 0xff) * 2 - 255)); g_lBenchSink += ah.Atan4 + ah.Hyp2));
+  fprintf(pf, "  old GetATan2           %6.2f\n", BENCH_NS(lLoops,
+      g_lBenchSink += BenchOldATan2((short)((lBench & 0xff) * 2 - 255), (short)(((lBench >> 8) & 0xff) * 2 - 255), &lHyp2) + lHyp2));
+  fprintf(pf, "  atan2 + hypot <cmath>  %6.2f\n", BENCH_NS(lLoops,
+      double dX = (lBench & 0xff) * 2 - 255; double dY = ((lBench >> 8) & 0xff) * 2 - 255;
+      g_lBenchSink += (long)(atan2(dY, dX) * c4DEC) + (long)(hypot(dX, dY) * c2DEC)));
+  fprintf(pf, "ATmega cycle estimate (cost model above):\n");
+  fprintf(pf, "  ATan2Hyp, constant shifts   %5ld\n", BenchAvrATan2Hyp(false));
+  fprintf(pf, "  ATan2Hyp, variable shifts   %5ld\n", BenchAvrATan2Hyp(true));
+  fprintf(pf, "  old GetATan2 mean / max     %5ld / %ld\n", lOldSum / lCnt, lOldMax);
+}
+
+//--------------------------------------------------------------------
+// Runs all of the checks
+//--------------------------------------------------------------------
+static void HostBench(FILE *pf)
+{
+  BenchSinCos(pf);
+  BenchATan2Hyp(pf);
+}
+#endif
@@ -0,0 +1,24 @@
+//====================================================================
+// Host build - PS2 controller that is always connected and idle.
+//====================================================================
+#ifndef _PHOENIX_HOST_PS2X_LIB_H_
+#define _PHOENIX_HOST_PS2X_LIB_H_
+#include <Arduino.h>
+
+enum {
+  PSB_SELECT = 1, PSB_L3, PSB_R3, PSB_START, PSB_PAD_UP, PSB_PAD_RIGHT, PSB_PAD_DOWN, PSB_PAD_LEFT,
+  PSB_L2, PSB_R2, PSB_L1, PSB_R1, PSB_TRIANGLE, PSB_CIRCLE, PSB_CROSS, PSB_SQUARE };
+enum {
+  PSS_RX = 5, PSS_RY, PSS_LX, PSS_LY };
+
+class PS2X {
+public:
+  byte config_gamepad(int, int, int, int, bool = false, bool = false) { return 0; }
+  void reconfig_gamepad(void) {}
+  bool read_gamepad(bool = false, byte = 0) { return true; }
+  bool Button(uint16_t) { return false; }
+  bool ButtonPressed(uint16_t) { return false; }
+  unsigned int ButtonDataByte(void) { return 0xffff; }
+  byte Analog(byte) { return 128; }
+};
+#endif
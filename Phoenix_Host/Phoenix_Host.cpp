@@ -0,0 +1,223 @@
+//====================================================================
+//Project Lynxmotion Phoenix
+//
+// Host (Linux) build of the Phoenix code.
+//
+// Builds one robot configuration the same way its sketch does, with
+// the Arduino core replaced by the stand-ins in this directory, and
+// runs loop() in simulated time.  Useful to benchmark and regression
+// test changes to the IK, gaits or servo drivers without hardware.
+//
+// Selected with defines on the command line:
+//   HOST_CFG    - configuration header, e.g. "THex_PS2_SSC32/Hex_Cfg.h"
+//   HOST_INPUT  - input controller, defaults to <Phoenix_Input_Host.h>
+//   HOST_DRIVER - servo driver, defaults to <Phoenix_Driver_SSC32.h>,
+//                 or to <Phoenix_Driver_AX12.h> if HOST_AX12 is defined
+// or HOST_SKETCH - a whole sketch, e.g. "PhXQuadV2_Commander_AX12_Stock/PhXQuadV2_Commander_AX12_Stock.ino",
+//                  for sketches that add their own gaits or setup code.
+//
+// Note: int is 32 bits on the host but 16 bits on the AVR, so an int
+// expression that overflows on the robot can give the right answer
+// here.  The host build does not catch those; check the ranges by hand.
+//
+// SSC-32 example (run from the directory holding the libraries):
+//   g++ -O2 -Wall -fpermissive -IPhoenix_Host -IPhoenix -IPhoenix_Driver_SSC32
+//     -DHOST_CFG='"THex_PS2_SSC32/Hex_Cfg.h"' Phoenix_Host/Phoenix_Host.cpp -o phoenix
+//
+// AX-12 example:
+//   g++ -O2 -Wall -fpermissive -IPhoenix_Host -IPhoenix -IPhoenix_Driver_AX12
+//     -DHOST_CFG='"PhantomX_Commander_AX12_Stock/Hex_Cfg.h"' -DHOST_AX12 Phoenix_Host/Phoenix_Host.cpp
+//     Phoenix_Host/ax12.cpp Phoenix_Driver_AX12/BioloidEX.cpp -o phoenix
+//
+// Usage: phoenix [-n frames] [-s servo-capture-file] [-d debug-capture-file]
+//                [-e 0|1] [-f frame-csv-file] [-t tx-buffer-bytes] [-g seq:steps:ms]
+//                [-x servo-id] [-l servo-id:pct] [-b 1]
+//   -s captures Serial1 (the SSC-32 on most configs, the AX-12 bus on
+//   AX-12 configs), -d captures Serial,
+//   "-" for stdout.  Prints the simulated and the host (wall clock) time
+//   of the run.  Other input controllers need their library directory
+//   on the include path as well.
+//   -e 1 puts the SSC-32 emulator (SSC32_Emulator.h) on SSCSerial: the
+//   port then runs at the real baud, answers queries and prints the
+//   wire time of the group moves.  -f writes one CSV line per group
+//   move, -t sets the port's TX buffer (64, 0 - never blocks) and -g
+//   adds a GP sequence to the emulated EEPROM.
+//   AX-12 configs always run on the virtual Dynamixel bus
+//   (AX12_Emulator.h), with a servo for each id in cPinTable; -x takes
+//   one off the bus, -l has one make only pct% of its moving speed
+//   (0 for the id - all of them).  It prints the bus time used per frame (writePose
+//   to writePose) and -f writes it for every frame to a CSV file.
+//   -b 1 prints the accuracy and speed of the fixed point math
+//   (Host_Bench.h) instead of running loop().
+//====================================================================
+#define DEFINE_HEX_GLOBALS
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <time.h>
+
+#if !defined(HOST_CFG) && !defined(HOST_SKETCH)
+#error Define HOST_CFG (or HOST_SKETCH) to the configuration to build
+#endif
+#ifndef HOST_INPUT
+#define HOST_INPUT <Phoenix_Input_Host.h>
+#endif
+#ifdef HOST_AX12
+// The AX-12 configs (PyPose sequences) need these ahead of Hex_Cfg.h
+#include <ax12.h>
+#include <BioloidEx.h>
+#ifndef HOST_DRIVER
+#define HOST_DRIVER <Phoenix_Driver_AX12.h>
+#endif
+#endif
+#ifndef HOST_DRIVER
+#define HOST_DRIVER <Phoenix_Driver_SSC32.h>
+#endif
+
+//--------------------------------------------------------------------
+// Host state used by the Arduino stand-ins.
+//--------------------------------------------------------------------
+unsigned long g_ulHostMicros;
+volatile uint32_t g_abHostPorts[16];
+uint16_t g_awHostAnalog[8] = {
+  800, 800, 800, 800, 800, 800, 800, 800};
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+HardwareSerial Serial3;
+EEPROMClass EEPROM;
+
+#ifdef HOST_SKETCH
+#include HOST_SKETCH
+#else
+#include HOST_CFG
+#include <Phoenix.h>
+#include HOST_INPUT
+#include HOST_DRIVER
+#include <Phoenix_Code.h>
+#endif
+
+#include <Host_Bench.h>
+
+#ifdef SSCSerial
+#include <SSC32_Emulator.h>
+SSC32Emulator g_SSCEmu;
+#endif
+#ifdef HOST_AX12
+#include <AX12_Emulator.h>
+#endif
+
+//--------------------------------------------------------------------
+// Open a capture file, "-" is stdout.
+//--------------------------------------------------------------------
+static FILE *HostOpenCapture(const char *pszName)
+{
+  if (!strcmp(pszName, "-"))
+    return stdout;
+  FILE *pf = fopen(pszName, "wb");
+  if (!pf)
+    perror(pszName);
+  return pf;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long ulFrames = 400;
+  boolean fBench = false;
+  FILE *pfFrames = NULL;
+#ifdef SSCSerial
+  boolean fEmu = false;
+  uint16_t cbTxBuffer = 64;
+#endif
+  int i;
+
+#ifdef HOST_AX12
+  for (i = 0; i < NUMSERVOS; i++)
+    g_AXEmu.AddServo(pgm_read_byte(&cPinTable[i]));
+#endif
+
+  for (i = 1; i < argc - 1; i += 2) {
+    if (!strcmp(argv[i], "-n"))
+      ulFrames = strtoul(argv[i+1], NULL, 0);
+    else if (!strcmp(argv[i], "-s"))
+#ifdef HOST_AX12
+      g_AXEmu.pfCapture = HostOpenCapture(argv[i+1]);
+#else
+      Serial1.pfCapture = HostOpenCapture(argv[i+1]);
+#endif
+    else if (!strcmp(argv[i], "-d"))
+      Serial.pfCapture = HostOpenCapture(argv[i+1]);
+    else if (!strcmp(argv[i], "-f"))
+      pfFrames = HostOpenCapture(argv[i+1]);
+    else if (!strcmp(argv[i], "-b"))
+      fBench = atoi(argv[i+1]) != 0;
+#ifdef HOST_AX12
+    else if (!strcmp(argv[i], "-x"))
+      g_AXEmu.RemoveServo(atoi(argv[i+1]));
+    else if (!strcmp(argv[i], "-l")) {
+      unsigned uId, uPct;
+      if (sscanf(argv[i+1], "%u:%u", &uId, &uPct) != 2)
+        break;
+      for (int iId = 0; iId < cAXEmuIds; iId++)
+        if (!uId || (iId == (int)uId))
+          g_AXEmu.SetSpeedPct(iId, uPct);
+    }
+#endif
+#ifdef SSCSerial
+    else if (!strcmp(argv[i], "-e"))
+      fEmu = atoi(argv[i+1]) != 0;
+    else if (!strcmp(argv[i], "-t"))
+      cbTxBuffer = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-g")) {
+      unsigned uSeq, uSteps, uMs;
+      if (sscanf(argv[i+1], "%u:%u:%u", &uSeq, &uSteps, &uMs) != 3)
+        break;
+      g_SSCEmu.AddSequence(uSeq, uSteps, uMs);
+    }
+#endif
+    else
+      break;
+  }
+  if (i < argc) {
+    fprintf(stderr, "usage: %s [-n frames] [-s servo-capture-file] [-d debug-capture-file]\n"
+        "  [-e 0|1] [-f frame-csv-file] [-t tx-buffer-bytes] [-g seq:steps:ms] [-x servo-id] [-l servo-id:pct]\n"
+        "  [-b 1]\n", argv[0]);
+    return 1;
+  }
+  if (fBench) {
+    HostBench(stdout);
+    return 0;
+  }
+#ifdef SSCSerial
+  if (fEmu || pfFrames)
+    g_SSCEmu.Attach(SSCSerial, cbTxBuffer);
+#endif
+
+  clock_t clkStart = clock();
+  setup();
+  for (unsigned long ulFrame = 0; ulFrame < ulFrames; ulFrame++)
+    loop();
+  double dHostMs = (double)(clock() - clkStart) * 1000.0 / CLOCKS_PER_SEC;
+
+  fflush(NULL);
+  fprintf(stderr, "%lu frames, simulated %lu ms, host %.1f ms\n", ulFrames, g_ulHostMicros / 1000, dHostMs);
+#ifdef OPT_SSC_DELTA_MOVES
+  fprintf(stderr, "SSC-32 bytes saved by delta moves: %lu\n", g_ulSSCBytesSaved);
+#endif
+#ifdef SSCSerial
+  if (fEmu || pfFrames) {
+    g_SSCEmu.PrintSummary(stderr);
+    g_SSCEmu.PrintServos(stderr);
+    if (pfFrames)
+      g_SSCEmu.PrintFrames(pfFrames);
+  }
+#endif
+#ifdef HOST_AX12
+  g_AXEmu.PrintSummary(stderr);
+  g_AXEmu.PrintServos(stderr);
+  if (pfFrames)
+    g_AXEmu.PrintFrames(pfFrames);
+#endif
+  if (pfFrames && (pfFrames != stdout))
+    fclose(pfFrames);
+  return 0;
+}
@@ -0,0 +1,82 @@
+//====================================================================
+//Project Lynxmotion Phoenix
+//
+// Host build - scripted input controller.
+//
+// Drives the robot through a fixed sequence keyed on the frame count,
+// so runs are repeatable:
+//   frame   2 - robot on, body raised
+//   frame  10 - walk forward, 120 - add strafe, 150 - balance mode on
+//   frame 220 - rotate in place, 240 - gait 2, 280 - last gait
+//   frame 300 - body pitch/roll/yaw sweeps
+//   frame 380 - robot off
+// Define HOST_GAIT0 to select a gait before the walk starts.
+//====================================================================
+#ifndef _PHOENIX_INPUT_HOST_H_
+#define _PHOENIX_INPUT_HOST_H_
+
+unsigned int g_uHostInputFrame;     // Number of times ControlInput was called
+
+InputController g_InputController;  // Our Input controller
+
+//==============================================================================
+// Init - nothing to set up.
+//==============================================================================
+void InputController::Init(void)
+{
+  g_uHostInputFrame = 0;
+}
+
+//==============================================================================
+// AllowControllerInterrupts - nothing to do.
+//==============================================================================
+void InputController::AllowControllerInterrupts(boolean /*fAllow*/)
+{
+}
+
+//==============================================================================
+// ControlInput - update g_InControlState from the script.
+//==============================================================================
+void InputController::ControlInput(void)
+{
+  unsigned int n = g_uHostInputFrame++;
+
+  g_InControlState.fRobotOn = (n >= 2) && (n < 380);
+  g_InControlState.TravelLength.x = ((n > 120) && (n < 200)) ? 25 : 0;
+  g_InControlState.TravelLength.z = ((n > 10) && (n < 200)) ? -40 : 0;
+  g_InControlState.TravelLength.y = ((n > 220) && (n < 300)) ? 20 : 0;
+  g_InControlState.BodyRot1.x = (n > 300) ? (short)((int)(n % 40) * 5 - 100) : 0;
+  g_InControlState.BodyRot1.z = (n > 320) ? (short)((int)(n % 30) * 4 - 60) : 0;
+  g_InControlState.BodyRot1.y = (n > 340) ? 80 : 0;
+  g_InControlState.BodyPos.y = (n > 5) ? 30 : 0;
+  g_InControlState.BalanceMode = (n > 150) && (n < 260);
+#ifdef HOST_GAIT0
+  if (n == 1) {
+    g_InControlState.GaitType = HOST_GAIT0;
+    GaitSelect();
+  }
+#endif
+  if (n == 240) {
+    g_InControlState.GaitType = 2;
+    GaitSelect();
+  }
+  if (n == 280) {
+    g_InControlState.GaitType = NUM_GAITS - 1;
+    GaitSelect();
+  }
+  g_InControlState.InputTimeDelay = 0;
+  g_InControlState.SpeedControl = 0;
+}
+
+#ifdef OPT_TERMINAL_MONITOR_IC
+void InputController::ShowTerminalCommandList(void)
+{
+}
+
+boolean InputController::ProcessTerminalCommand(byte *psz, byte bLen)
+{
+  return false;
+}
+#endif
+
+#endif
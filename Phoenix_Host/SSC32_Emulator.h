@@ -0,0 +1,431 @@
+//====================================================================
+//Project Lynxmotion Phoenix
+//
+// Host build - SSC-32 emulator.
+//
+// Attach it to the port the SSC-32 driver uses (SSCSerial) and it
+// takes the place of the board:
+//   - ASCII group moves (#<pin>P<pw>...T<time><CR>), binary group
+//     moves (0x80+pin, PW, then 0xA1, time) and P0 frees.
+//   - Servo motion over the T time of each group move.
+//   - The GP player: PL, SQ, SM, QPL and EER reads of the sequence
+//     table, for the sequences added with AddSequence.
+//   - Q (. when all servos are done, + while moving) and QP.
+// Every byte is timed at the port's baud, so each group move records
+// its size, when it started and finished on the wire and the time
+// since the previous one.  PrintSummary/PrintFrames report them.
+//====================================================================
+#ifndef _PHOENIX_HOST_SSC32_EMULATOR_H_
+#define _PHOENIX_HOST_SSC32_EMULATOR_H_
+#include <Arduino.h>
+
+#define cSSCEmuPins       32
+#define cSSCEmuEEPROM     1024
+#define cSSCEmuSeqs       32
+#define cSSCEmuReplies    64          // answer bytes not read yet, power of 2
+
+typedef struct _SSCEmuFrame {
+  uint16_t    cb;             // bytes of the group move, including the T and <CR>
+  uint8_t     cServos;        // servos in it
+  uint16_t    wMoveTime;      // T in ms, 0 if none
+  uint64_t    nsStart;        // first byte started on the wire
+  uint64_t    nsEnd;          // last byte in, the move starts
+} SSCEMUFRAME;
+
+typedef struct _SSCEmuServo {
+  uint16_t    wFrom;          // PW in us at nsFrom, 0 - off
+  uint16_t    wTo;            // PW in us at nsTo
+  uint64_t    nsFrom;
+  uint64_t    nsTo;
+} SSCEMUSERVO;
+
+class SSC32Emulator : public HostSerialDevice {
+public:
+  SSC32Emulator() : paFrames(NULL), cFrames(0), ulBytes(0), ulQueries(0), ulBadCmds(0),
+    _pPort(NULL), _cchLine(0), _cbBin(0), _cbFrame(0), _cServosFrame(0), _nsFrameStart(0),
+    _iReplyHead(0), _iReplyTail(0), _cFramesAlloc(0), _fPlaying(false), _bPlaySeq(0), _nsPlayStart(0), _sSM(100) {
+    memset(_aServos, 0, sizeof(_aServos));
+    memset(_awPending, 0, sizeof(_awPending));
+    memset(_afPending, 0, sizeof(_afPending));
+    memset(_abEEPROM, 0, sizeof(_abEEPROM));
+    memset(_awStepTime, 0, sizeof(_awStepTime));
+    _wEEPROMFree = 2 * cSSCEmuSeqs;
+  }
+
+  //--------------------------------------------------------------------
+  // Attach to the port, cbTxBuffer is the size of the port's TX buffer
+  // (64 on the AVR HardwareSerial).
+  //--------------------------------------------------------------------
+  void Attach(HardwareSerial &port, uint16_t cbTxBuffer = 64) {
+    _pPort = &port;
+    port.pDevice = this;
+    port.cbTxBuffer = cbTxBuffer;
+  }
+
+  //--------------------------------------------------------------------
+  // Add a GP sequence of cSteps steps of wStepTime ms each.
+  //--------------------------------------------------------------------
+  void AddSequence(uint8_t bSeq, uint8_t cSteps, uint16_t wStepTime) {
+    if ((bSeq >= cSSCEmuSeqs) || (_wEEPROMFree >= cSSCEmuEEPROM))
+      return;
+    _abEEPROM[bSeq*2] = _wEEPROMFree & 0xff;
+    _abEEPROM[bSeq*2+1] = _wEEPROMFree >> 8;
+    _abEEPROM[_wEEPROMFree] = cSteps;
+    _wEEPROMFree += 16;
+    _awStepTime[bSeq] = wStepTime;
+  }
+
+  //--------------------------------------------------------------------
+  // Pulse width of a pin at the given time, 0 if it is off.
+  //--------------------------------------------------------------------
+  uint16_t ServoPW(uint8_t bPin, uint64_t ns) {
+    SSCEMUSERVO *ps = &_aServos[bPin & (cSSCEmuPins-1)];
+    if (!ps->wTo || !ps->wFrom || (ns >= ps->nsTo))
+      return ps->wTo;
+    if (ns <= ps->nsFrom)
+      return ps->wFrom;
+    return ps->wFrom + (int)((int64_t)((int)ps->wTo - (int)ps->wFrom) * (int64_t)(ns - ps->nsFrom) / (int64_t)(ps->nsTo - ps->nsFrom));
+  }
+  uint16_t ServoTarget(uint8_t bPin) {
+    return _aServos[bPin & (cSSCEmuPins-1)].wTo;
+  }
+  boolean FMoving(uint64_t ns) {
+    for (int i = 0; i < cSSCEmuPins; i++)
+      if (_aServos[i].wTo && (ns < _aServos[i].nsTo))
+        return true;
+    return false;
+  }
+
+  //--------------------------------------------------------------------
+  // HostSerialDevice
+  //--------------------------------------------------------------------
+  virtual void HostReceive(uint8_t b, uint64_t nsArrived) {
+    ulBytes++;
+    if (!_cbFrame)
+      _nsFrameStart = nsArrived - (_pPort? _pPort->NsPerByte() : 0);
+    _cbFrame++;
+
+    if (_cbBin) {
+      // In the middle of a binary command
+      _abBin[_cbBin++] = b;
+      if (_cbBin == 3) {
+        _cbBin = 0;
+        word w = (_abBin[1] << 8) | _abBin[2];
+        if (_abBin[0] == 0xA1)
+          Commit(nsArrived, w);
+        else if (_abBin[0] >= 0x80 && (_abBin[0] < 0x80 + cSSCEmuPins))
+          Pending(_abBin[0] - 0x80, w);
+        else
+          ulBadCmds++;
+      }
+    }
+    else if (b >= 0x80) {
+      _abBin[0] = b;
+      _cbBin = 1;
+    }
+    else if (b == '\r') {
+      _szLine[_cchLine] = 0;
+      Execute(nsArrived);
+      _cchLine = 0;
+    }
+    else if ((b != '\n') && (_cchLine < (int)sizeof(_szLine) - 1))
+      _szLine[_cchLine++] = b;
+    else if (b == '\n' && !_cchLine && !_cServosFrame)
+      _cbFrame--;           // <LF> after a <CR> - counted in the frame it ends
+  }
+  virtual int HostPeek(uint64_t nsNow) {
+    if ((_iReplyHead == _iReplyTail) || (_ansReply[_iReplyTail] > nsNow))
+      return -1;
+    return _abReply[_iReplyTail];
+  }
+  virtual int HostRead(uint64_t nsNow) {
+    int ich = HostPeek(nsNow);
+    if (ich >= 0)
+      _iReplyTail = (_iReplyTail + 1) & (cSSCEmuReplies - 1);
+    return ich;
+  }
+
+  //--------------------------------------------------------------------
+  // Reports
+  //--------------------------------------------------------------------
+  void PrintFrames(FILE *pf) {
+    fprintf(pf, "frame,bytes,servos,T_ms,start_us,wire_us,period_us\n");
+    for (unsigned long i = 0; i < cFrames; i++) {
+      SSCEMUFRAME *pfr = &paFrames[i];
+      fprintf(pf, "%lu,%u,%u,%u,%llu,%llu,%llu\n", i, pfr->cb, pfr->cServos, pfr->wMoveTime,
+          (unsigned long long)(pfr->nsStart / 1000), (unsigned long long)((pfr->nsEnd - pfr->nsStart) / 1000),
+          (unsigned long long)(i? (pfr->nsEnd - paFrames[i-1].nsEnd) / 1000 : 0));
+    }
+  }
+
+  void PrintSummary(FILE *pf) {
+    unsigned long ulFrameBytes = 0, cbMax = 0, cOverT = 0, cOverPeriod = 0;
+    uint64_t nsWire = 0, nsWireMax = 0, nsPeriodMin = (uint64_t)-1;
+    for (unsigned long i = 0; i < cFrames; i++) {
+      SSCEMUFRAME *pfr = &paFrames[i];
+      uint64_t ns = pfr->nsEnd - pfr->nsStart;
+      ulFrameBytes += pfr->cb;
+      if (pfr->cb > cbMax)
+        cbMax = pfr->cb;
+      nsWire += ns;
+      if (ns > nsWireMax)
+        nsWireMax = ns;
+      if (pfr->wMoveTime && (ns > (uint64_t)pfr->wMoveTime * 1000000))
+        cOverT++;
+      if (i) {
+        uint64_t nsPeriod = pfr->nsEnd - paFrames[i-1].nsEnd;
+        if (nsPeriod < nsPeriodMin)
+          nsPeriodMin = nsPeriod;
+        if (ns > nsPeriod)
+          cOverPeriod++;
+      }
+    }
+    fprintf(pf, "SSC-32 %lu baud: %lu bytes, %lu group moves, %lu queries, %lu bad commands\n",
+        _pPort? _pPort->ulBaud : 0, ulBytes, cFrames, ulQueries, ulBadCmds);
+    if (cFrames) {
+      fprintf(pf, "  bytes/move avg %lu max %lu, wire time avg %llu max %llu us, shortest period %llu us\n",
+          ulFrameBytes / cFrames, cbMax, (unsigned long long)(nsWire / cFrames / 1000),
+          (unsigned long long)(nsWireMax / 1000), (unsigned long long)((cFrames > 1)? nsPeriodMin / 1000 : 0));
+      fprintf(pf, "  moves longer on the wire than their T: %lu, than the time since the previous move: %lu\n",
+          cOverT, cOverPeriod);
+    }
+  }
+
+  void PrintServos(FILE *pf) {
+    fprintf(pf, "  servo targets:");
+    for (int i = 0; i < cSSCEmuPins; i++)
+      if (_aServos[i].wTo)
+        fprintf(pf, " %d:%u", i, _aServos[i].wTo);
+    fprintf(pf, "\n");
+  }
+
+  SSCEMUFRAME     *paFrames;          // one per group move
+  unsigned long   cFrames;
+  unsigned long ulBytes;              // everything received
+  unsigned long ulQueries;            // commands that were answered
+  unsigned long ulBadCmds;            // commands we did not understand
+
+private:
+  //--------------------------------------------------------------------
+  // Servo move waiting for its commit
+  //--------------------------------------------------------------------
+  void Pending(uint8_t bPin, uint16_t wPW) {
+    _awPending[bPin] = wPW;
+    if (!_afPending[bPin]) {
+      _afPending[bPin] = true;
+      _cServosFrame++;
+    }
+  }
+
+  //--------------------------------------------------------------------
+  // Start the group move, all the servos get there at the same time.
+  //--------------------------------------------------------------------
+  void Commit(uint64_t ns, uint16_t wMoveTime) {
+    if (_cServosFrame) {
+      for (int i = 0; i < cSSCEmuPins; i++) {
+        if (_afPending[i]) {
+          SSCEMUSERVO *ps = &_aServos[i];
+          ps->wFrom = ServoPW(i, ns);
+          ps->nsFrom = ns;
+          ps->wTo = _awPending[i];
+          ps->nsTo = ns + (uint64_t)wMoveTime * 1000000;
+          _afPending[i] = false;
+        }
+      }
+      if (cFrames == _cFramesAlloc) {
+        _cFramesAlloc = _cFramesAlloc? _cFramesAlloc * 2 : 1024;
+        paFrames = (SSCEMUFRAME*)realloc(paFrames, _cFramesAlloc * sizeof(SSCEMUFRAME));
+      }
+      SSCEMUFRAME *pfr = &paFrames[cFrames++];
+      pfr->cb = _cbFrame;
+      pfr->cServos = _cServosFrame;
+      pfr->wMoveTime = wMoveTime;
+      pfr->nsStart = _nsFrameStart;
+      pfr->nsEnd = ns;
+    }
+    _cServosFrame = 0;
+    _cbFrame = 0;
+  }
+
+  //--------------------------------------------------------------------
+  // Queue an answer, it comes back at the same baud.
+  //--------------------------------------------------------------------
+  void Reply(const uint8_t *pb, int cb, uint64_t ns) {
+    uint64_t nsByte = _pPort? _pPort->NsPerByte() : 0;
+    ulQueries++;
+    while (cb--) {
+      ns += nsByte;
+      _ansReply[_iReplyHead] = ns;
+      _abReply[_iReplyHead] = *pb++;
+      _iReplyHead = (_iReplyHead + 1) & (cSSCEmuReplies - 1);
+      if (_iReplyHead == _iReplyTail)
+        _iReplyTail = (_iReplyTail + 1) & (cSSCEmuReplies - 1);   // full, drop the oldest
+    }
+  }
+
+  static long Number(const char *&psz) {
+    long l = 0;
+    boolean fNeg = (*psz == '-');
+    if (fNeg)
+      psz++;
+    while ((*psz >= '0') && (*psz <= '9'))
+      l = l * 10 + (*psz++ - '0');
+    return fNeg? -l : l;
+  }
+
+  //--------------------------------------------------------------------
+  // Run the ASCII line in _szLine.
+  //--------------------------------------------------------------------
+  void Execute(uint64_t ns) {
+    const char *psz = _szLine;
+    uint16_t wMoveTime = 0;
+    boolean fGroup = false;
+
+    while (*psz == ' ')
+      psz++;
+    if (!*psz) {
+      Commit(ns, 0);
+      return;
+    }
+    if (!strncmp(psz, "QPL", 3)) {
+      psz += 3;
+      QueryPlayer(ns);
+      _cbFrame = 0;
+      return;
+    }
+    if (!strncmp(psz, "QP", 2)) {
+      psz += 2;
+      uint8_t b = ServoPW(Number(psz) & (cSSCEmuPins-1), ns) / 10;
+      Reply(&b, 1, ns);
+      _cbFrame = 0;
+      return;
+    }
+    if (!strcmp(psz, "Q")) {
+      uint8_t b = FMoving(ns)? '+' : '.';
+      Reply(&b, 1, ns);
+      _cbFrame = 0;
+      return;
+    }
+    if (!strncmp(psz, "EER -", 5)) {
+      psz += 5;
+      long lAddr = Number(psz);
+      long cb = 1;
+      if (*psz == ';') {
+        psz++;
+        cb = Number(psz);
+      }
+      uint8_t ab[32];
+      int cbReply = 0;
+      for (; (cb > 0) && (cbReply < (int)sizeof(ab)); cb--, lAddr++)
+        ab[cbReply++] = ((lAddr >= 0) && (lAddr < cSSCEmuEEPROM))? _abEEPROM[lAddr] : 0xff;
+      Reply(ab, cbReply, ns);
+      _cbFrame = 0;
+      return;
+    }
+    if (!strncmp(psz, "PL", 2)) {
+      psz += 2;
+      Number(psz);          // only player 0
+      if (!*psz)
+        _fPlaying = false;
+      while (*psz) {
+        if (!strncmp(psz, "SQ", 2)) {
+          psz += 2;
+          _bPlaySeq = Number(psz);
+          _fPlaying = (_bPlaySeq < cSSCEmuSeqs) && _awStepTime[_bPlaySeq];
+          _nsPlayStart = ns;
+        }
+        else if (!strncmp(psz, "SM", 2)) {
+          psz += 2;
+          _sSM = Number(psz);
+        }
+        else if (!strncmp(psz, "ONCE", 4))
+          psz += 4;
+        else {
+          ulBadCmds++;
+          break;
+        }
+      }
+      _cbFrame = 0;
+      return;
+    }
+
+    // Group move
+    while (*psz) {
+      if (*psz == '#') {
+        psz++;
+        long lPin = Number(psz);
+        long lPW = -1;
+        while (*psz && (*psz != '#') && (*psz != 'T')) {
+          char ch = *psz++;
+          long l = Number(psz);
+          if (ch == 'P')
+            lPW = l;
+          else if (ch != 'S') {
+            ulBadCmds++;
+            break;
+          }
+        }
+        if ((lPin >= 0) && (lPin < cSSCEmuPins) && (lPW >= 0)) {
+          Pending(lPin, lPW);
+          fGroup = true;
+        }
+      }
+      else if (*psz == 'T') {
+        psz++;
+        wMoveTime = Number(psz);
+      }
+      else {
+        ulBadCmds++;
+        break;
+      }
+    }
+    if (fGroup)
+      Commit(ns, wMoveTime);
+    else
+      _cbFrame = 0;
+  }
+
+  //--------------------------------------------------------------------
+  // QPL - sequence, from step, to step, time left in the step (100ms)
+  //--------------------------------------------------------------------
+  void QueryPlayer(uint64_t ns) {
+    uint8_t ab[4] = {0xff, 0, 0, 0};
+    if (_fPlaying) {
+      uint8_t cSteps = _abEEPROM[_abEEPROM[_bPlaySeq*2] | (_abEEPROM[_bPlaySeq*2+1] << 8)];
+      uint64_t msPlay = (ns - _nsPlayStart) / 1000000 * _sSM / 100;
+      uint16_t wStepTime = _awStepTime[_bPlaySeq];
+      uint32_t iStep = cSteps? (msPlay / wStepTime) % cSteps : 0;
+      ab[0] = _bPlaySeq;
+      ab[1] = iStep;
+      ab[2] = (cSteps && (iStep + 1 < cSteps))? iStep + 1 : iStep;
+      ab[3] = (wStepTime - msPlay % wStepTime) / 100;
+    }
+    Reply(ab, sizeof(ab), ns);
+  }
+
+  HardwareSerial  *_pPort;
+  char            _szLine[256];
+  int             _cchLine;
+  uint8_t         _abBin[3];
+  int             _cbBin;
+  uint16_t        _cbFrame;           // bytes since the last commit
+  uint8_t         _cServosFrame;      // servos waiting for the commit
+  uint64_t        _nsFrameStart;
+  uint16_t        _awPending[cSSCEmuPins];
+  boolean         _afPending[cSSCEmuPins];
+  SSCEMUSERVO     _aServos[cSSCEmuPins];
+  uint64_t        _ansReply[cSSCEmuReplies];  // when each answer byte has arrived
+  uint8_t         _abReply[cSSCEmuReplies];
+  uint8_t         _iReplyHead;
+  uint8_t         _iReplyTail;
+  unsigned long   _cFramesAlloc;
+
+  uint8_t         _abEEPROM[cSSCEmuEEPROM];
+  uint16_t        _wEEPROMFree;
+  uint16_t        _awStepTime[cSSCEmuSeqs];
+  boolean         _fPlaying;
+  uint8_t         _bPlaySeq;
+  uint64_t        _nsPlayStart;
+  short           _sSM;               // speed multiplier, 100 - normal
+};
+#endif
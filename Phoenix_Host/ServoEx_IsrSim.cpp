@@ -0,0 +1,249 @@
+//====================================================================
+//Project Lynxmotion Phoenix
+//
+// Host (Linux) simulator of the ServoEx timer interrupts on a Mega.
+//
+// Models the two servo timers (5 and 1, 12 servos each) and the timer0
+// millis interrupt.  Interrupts do not nest, when several are pending
+// the lowest vector runs first.  Each servo timer runs the sequence of
+// handle_interrupts: refresh (TCNT = 0), then per channel drop the
+// previous pin, raise the next one and set OCR for its width.  Widths
+// are random between 1000 and 2000us, over 4 seconds of simulated time.
+//
+// The costs are estimated CPU cycles at 16MHz (timer tick = 8 cycles,
+// prescale 8), from the instruction counts of the Arduino 1.0
+// digitalWrite and of a read-modify-write of a precomputed port
+// register.  Prints the error of the pulse widths (measured - commanded)
+// for the Chr3_PS2_ServoEx pin map with 18 and 24 servos, each way of
+// writing the pins and TRIM_DURATION 2 and 1.
+//
+// Not part of the Phoenix build, run from the directory holding the libraries:
+//   g++ -O2 -Wall Phoenix_Host/ServoEx_IsrSim.cpp -o isrsim && ./isrsim
+//====================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#define cCpuHz        16000000L
+#define cSimCycles    (cCpuHz * 4)     // 4 seconds
+#define cTimer0Cycles 16384            // timer0 overflow, every 1024us
+#define cTimer0Vector 23
+#define cTimer0Isr    90               // millis interrupt
+#define cRefreshTicks 40000            // 20ms at 0.5us a tick
+
+//--------------------------------------------------------------------
+// Cycles of each part of the channel interrupt
+//--------------------------------------------------------------------
+typedef struct _IsrCost {
+  const char *pszName;
+  int   cPro, cEpi;     // prologue / epilogue (incl. reti)
+  int   cToLow;         // from start of body to the low edge (channel checks)
+  int   cLowEdge;       // cost of the low write up to the edge
+  int   cLowTail;       // rest of the low write
+  int   cMove;          // timed move update
+  int   cToTcnt;        // channel++ and checks up to TCNT read
+  int   cTcntToOcr;     // compute and write OCR
+  int   cHighEdge;      // cost of the high write up to the edge
+  int   cHighTail;
+  int   cPwmExtra;      // digitalWrite extra for pins on a timer (turnOffPWM)
+  int   cRefresh;       // body of refresh / reset interrupt
+} ISRCOST;
+
+// digitalWrite: call, 3 pgm lookups, NOT_A_PIN and timer tests, port
+// lookup, SREG/cli, RMW, SREG, ret.  ISR pushes all call clobbered regs.
+static const ISRCOST s_costDW   = {"digitalWrite", 44, 46, 20, 45, 8, 10, 14, 10, 45, 8, 18, 30};
+// port write: ldd pointer + mask, ld/and(or)/st.  Fewer regs to save.
+static const ISRCOST s_costPort = {"port write  ", 26, 28, 20, 12, 0, 10, 14, 10, 12, 0, 0, 30};
+
+// Mega pins with a PWM timer, digitalWrite has to turn it off
+static bool FPwmPin(int iPin) { return ((iPin >= 2) && (iPin <= 13)) || ((iPin >= 44) && (iPin <= 46)); }
+
+typedef struct _SimTimer {
+  int   iVector;                // lower - higher priority
+  std::vector<int> aiPins;
+  std::vector<int> awUs;        // commanded width for this frame
+  int   iChannel;               // -1 - refresh
+  long  lTcntBase;              // cycle when TCNT was 0
+  long  lCompareAt;             // cycle of next compare, -1 - none
+  long  lRiseAt;                // cycle the current pin went high
+} SIMTIMER;
+
+typedef struct _SimStats {
+  double dSum, dSum2, dMin, dMax;
+  long  lCnt;
+  long  lBusy;                  // cycles in interrupts
+  double dPwmSum, dDioSum;
+  long  lPwmCnt, lDioCnt;
+} SIMSTATS;
+
+static std::vector<double> s_adErr;
+
+static unsigned long SimRand(void)
+{
+  static unsigned long s_ulSeed = 12345;
+  s_ulSeed = s_ulSeed * 1103515245 + 12345;
+  return (s_ulSeed >> 16) & 0x7fff;
+}
+
+//--------------------------------------------------------------------
+// Run cSimCycles with cServos servos on the pins, TRIM_DURATION of
+// iTrimUs.  Each pulse width error goes in s_adErr.
+//--------------------------------------------------------------------
+static void SimRun(const ISRCOST &cost, int cServos, const int *piPins, int iTrimUs, SIMSTATS &st)
+{
+  SIMTIMER aTimers[2];
+  aTimers[0].iVector = 47;      // TIMER5_COMPA
+  aTimers[1].iVector = 17;      // TIMER1_COMPA
+  for (int i = 0; i < cServos; i++) {
+    aTimers[i / 12].aiPins.push_back(piPins[i]);
+    aTimers[i / 12].awUs.push_back(1500);
+  }
+  int cTimers = (cServos > 12)? 2 : 1;
+  for (int k = 0; k < cTimers; k++) {
+    aTimers[k].iChannel = -1;
+    aTimers[k].lTcntBase = 0;
+    aTimers[k].lCompareAt = 100 + k * 37;
+    aTimers[k].lRiseAt = 0;
+  }
+  long lTimer0At = cTimer0Cycles;
+  long lCpuFree = 0;            // cycle the running interrupt returns
+  SIMSTATS stInit = {0, 0, 1e9, -1e9, 0, 0, 0, 0, 0, 0};
+  st = stInit;
+
+  for (;;) {
+    // Next pending interrupt
+    long lAt = cSimCycles;
+    int iWho = -2;
+    for (int k = 0; k < cTimers; k++) {
+      if ((aTimers[k].lCompareAt >= 0) && (aTimers[k].lCompareAt < lAt)) {
+        lAt = aTimers[k].lCompareAt;
+        iWho = k;
+      }
+    }
+    if (lTimer0At < lAt) {
+      lAt = lTimer0At;
+      iWho = -1;
+    }
+    if (iWho == -2)
+      break;
+    long lStart = std::max(lAt, lCpuFree);
+    // If several are pending when the cpu frees, the lowest vector wins
+    if (lStart > lAt) {
+      int iBest = iWho;
+      int iBestVector = (iWho < 0)? cTimer0Vector : aTimers[iWho].iVector;
+      for (int k = 0; k < cTimers; k++) {
+        if ((aTimers[k].lCompareAt >= 0) && (aTimers[k].lCompareAt <= lStart) && (aTimers[k].iVector < iBestVector)) {
+          iBest = k;
+          iBestVector = aTimers[k].iVector;
+        }
+      }
+      if ((lTimer0At <= lStart) && (cTimer0Vector < iBestVector))
+        iBest = -1;
+      iWho = iBest;
+    }
+    lStart += 1 + SimRand() % 4 + 5 + 3;   // finish instruction, response, jmp
+    if (iWho == -1) {
+      lCpuFree = lStart + cTimer0Isr;
+      st.lBusy += lCpuFree - std::max(lAt, lCpuFree - cTimer0Isr - 9);
+      lTimer0At += cTimer0Cycles;
+      continue;
+    }
+
+    SIMTIMER &t = aTimers[iWho];
+    long l = lStart + cost.cPro;
+    t.lCompareAt = -1;
+    if (t.iChannel < 0) {
+      t.lTcntBase = l + 8 - ((l + 8) % 8);   // TCNT = 0 written
+      l += cost.cRefresh;
+    }
+    else {
+      // Drop the pin of this channel, that ends its pulse
+      l += cost.cToLow;
+      int iPin = t.aiPins[t.iChannel];
+      long lFall = l + cost.cLowEdge + (FPwmPin(iPin)? cost.cPwmExtra : 0);
+      double dErr = (lFall - t.lRiseAt) / 16.0 - t.awUs[t.iChannel];
+      s_adErr.push_back(dErr);
+      st.dSum += dErr;
+      st.dSum2 += dErr * dErr;
+      st.lCnt++;
+      st.dMin = std::min(st.dMin, dErr);
+      st.dMax = std::max(st.dMax, dErr);
+      if (FPwmPin(iPin)) {
+        st.dPwmSum += dErr;
+        st.lPwmCnt++;
+      }
+      else {
+        st.dDioSum += dErr;
+        st.lDioCnt++;
+      }
+      l = lFall + cost.cLowTail + cost.cMove;
+      t.awUs[t.iChannel] = 1000 + SimRand() % 1000;   // next frame's width
+    }
+    t.iChannel++;
+    l += cost.cToTcnt;
+    if (t.iChannel < (int)t.aiPins.size()) {
+      // Raise the next pin, its compare is TCNT + its width less the trim
+      long lTcnt = (l - t.lTcntBase) / 8;
+      int iPin = t.aiPins[t.iChannel];
+      int cTicks = (t.awUs[t.iChannel] - iTrimUs) * 2;
+      l += cost.cTcntToOcr;
+      t.lCompareAt = t.lTcntBase + (lTcnt + cTicks) * 8;
+      t.lRiseAt = l + cost.cHighEdge + (FPwmPin(iPin)? cost.cPwmExtra : 0);
+      l = t.lRiseAt + cost.cHighTail;
+    }
+    else {
+      // All channels done, wait for the end of the refresh interval
+      long lTcnt = (l - t.lTcntBase) / 8;
+      long lOcr = ((lTcnt + 4) < cRefreshTicks)? cRefreshTicks : lTcnt + 4;
+      t.lCompareAt = t.lTcntBase + lOcr * 8;
+      t.iChannel = -1;
+      l += 12;
+    }
+    lCpuFree = l + cost.cEpi;
+    st.lBusy += lCpuFree - (lStart - 9);
+  }
+}
+
+int main(void)
+{
+  // Chr3_PS2_ServoEx pins, attached RR RM RF LR LM LF, coxa/femur/tibia/tars
+  static const int s_aiPins24[] = {6,7,8,9, 34,35,36,37, 30,31,32,33, 2,3,4,5, 22,23,24,25, 26,27,28,29};
+  static const int s_aiPins18[] = {6,7,8, 34,35,36, 30,31,32, 2,3,4, 22,23,24, 26,27,28};
+  static const ISRCOST *s_apCosts[] = {&s_costDW, &s_costPort};
+  static const int s_acServos[] = {18, 24};
+  static const int s_aiTrims[] = {2, 1};
+
+  for (int iServos = 0; iServos < 2; iServos++) {
+    int cServos = s_acServos[iServos];
+    const int *piPins = (cServos == 24)? s_aiPins24 : s_aiPins18;
+    for (int iCost = 0; iCost < 2; iCost++) {
+      const ISRCOST *pCost = s_apCosts[iCost];
+      for (int iTrim = 0; iTrim < 2; iTrim++) {
+        SIMSTATS st;
+        s_adErr.clear();
+        SimRun(*pCost, cServos, piPins, s_aiTrims[iTrim], st);
+        std::sort(s_adErr.begin(), s_adErr.end());
+        double dP99 = s_adErr[s_adErr.size() * 99 / 100];
+        double dP999 = s_adErr[s_adErr.size() * 999 / 1000];
+        double dMean = st.dSum / st.lCnt;
+        double dSd = sqrt(st.dSum2 / st.lCnt - dMean * dMean);
+        printf("%d servos %s trim %d: err mean %+.2fus sd %.2fus range [%+.2f, %+.2f] pwm-pin %+.2f other %+.2f  p99 %+.2f p99.9 %+.2f isr load %.2f%%\n",
+            cServos, pCost->pszName, s_aiTrims[iTrim], dMean, dSd, st.dMin, st.dMax,
+            st.dPwmSum / st.lPwmCnt, st.dDioSum / st.lDioCnt, dP99, dP999,
+            100.0 * st.lBusy / cSimCycles);
+      }
+    }
+  }
+
+  // Cycles of one channel interrupt
+  for (int iCost = 0; iCost < 2; iCost++) {
+    const ISRCOST *pCost = s_apCosts[iCost];
+    int cCycles = 12 + pCost->cPro + pCost->cToLow + pCost->cLowEdge + pCost->cLowTail + pCost->cMove + pCost->cToTcnt +
+        pCost->cTcntToOcr + pCost->cHighEdge + pCost->cHighTail + pCost->cEpi;
+    printf("%s: channel ISR %d cycles (%.2fus), +%d on a PWM pin\n", pCost->pszName, cCycles, cCycles / 16.0,
+        2 * pCost->cPwmExtra);
+  }
+  return 0;
+}
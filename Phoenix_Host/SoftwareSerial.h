@@ -0,0 +1,13 @@
+//====================================================================
+// Host build - SoftwareSerial behaves like a hardware port.
+//====================================================================
+#ifndef _PHOENIX_HOST_SOFTWARESERIAL_H_
+#define _PHOENIX_HOST_SOFTWARESERIAL_H_
+#include <Arduino.h>
+
+class SoftwareSerial : public HardwareSerial {
+public:
+  SoftwareSerial(int, int) {}
+  void listen(void) {}
+};
+#endif
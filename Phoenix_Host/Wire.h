@@ -0,0 +1,4 @@
+//====================================================================
+// Host build - nothing in the host configurations talks I2C.
+//====================================================================
+#include <Arduino.h>
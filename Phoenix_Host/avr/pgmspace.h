@@ -0,0 +1,27 @@
+//====================================================================
+// Host build - program memory is ordinary memory on the host.
+//====================================================================
+#ifndef _PHOENIX_HOST_PGMSPACE_H_
+#define _PHOENIX_HOST_PGMSPACE_H_
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P   const char *
+#define PSTR(s) (s)
+#define F(s)    (s)
+typedef unsigned int prog_uint16_t;
+typedef uint8_t prog_uint8_t;
+
+// memcpy, as the tables read by word are not always declared as uint16_t
+static inline uint16_t HostPgmReadWord(const void *p) { uint16_t w; memcpy(&w, p, sizeof(w)); return w; }
+static inline uint32_t HostPgmReadDWord(const void *p) { uint32_t l; memcpy(&l, p, sizeof(l)); return l; }
+
+#define pgm_read_byte(p)        (*(const uint8_t *)(p))
+#define pgm_read_word(p)        HostPgmReadWord(p)
+#define pgm_read_dword(p)       HostPgmReadDWord(p)
+#define pgm_read_byte_near(p)   pgm_read_byte(p)
+#define pgm_read_word_near(p)   pgm_read_word(p)
+#define strcpy_P(d, s)          strcpy((d), (s))
+#define strlen_P(s)             strlen(s)
+#endif
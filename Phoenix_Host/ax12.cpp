@@ -0,0 +1,95 @@
+//====================================================================
+// Host build - the ax12 library on the virtual bus (AX12_Emulator.h).
+// The packet code is the Arbotix library's, so the bus sees the same
+// bytes and waits a robot would.
+//====================================================================
+#include <ax12.h>
+#include <AX12_Emulator.h>
+
+AX12Emulator g_AXEmu;
+unsigned char ax_rx_buffer[AX12_BUFFER_SIZE];
+
+void ax12Init(long baud)
+{
+  g_AXEmu.ulBaud = baud;
+}
+
+void setTX(int)
+{
+  g_AXEmu.SetTX();
+}
+
+void setRX(int)
+{
+  g_AXEmu.SetRX();
+}
+
+void setTXall()
+{
+  g_AXEmu.SetTX();
+}
+
+void ax12write(unsigned char data)
+{
+  g_AXEmu.Write(data);
+}
+
+int ax12ReadPacket(int length)
+{
+  if (length > AX12_BUFFER_SIZE)
+    length = AX12_BUFFER_SIZE;
+  return g_AXEmu.ReadPacket(ax_rx_buffer, length);
+}
+
+int ax12GetRegister(int id, int regstart, int length)
+{
+  setTX(id);
+  int checksum = ~((id + 6 + regstart + length) % 256);
+  ax12write(0xFF);
+  ax12write(0xFF);
+  ax12write(id);
+  ax12write(4);
+  ax12write(AX_READ_DATA);
+  ax12write(regstart);
+  ax12write(length);
+  ax12write(checksum);
+  setRX(id);
+  if (ax12ReadPacket(length + 6) > 0) {
+    if (length == 1)
+      return ax_rx_buffer[5];
+    return ax_rx_buffer[5] + (ax_rx_buffer[6] << 8);
+  }
+  return -1;
+}
+
+// As the library, these do not wait for the status packet
+void ax12SetRegister(int id, int regstart, int data)
+{
+  setTX(id);
+  int checksum = ~((id + 4 + AX_WRITE_DATA + regstart + (data & 0xff)) % 256);
+  ax12write(0xFF);
+  ax12write(0xFF);
+  ax12write(id);
+  ax12write(4);
+  ax12write(AX_WRITE_DATA);
+  ax12write(regstart);
+  ax12write(data & 0xff);
+  ax12write(checksum);
+  setRX(id);
+}
+
+void ax12SetRegister2(int id, int regstart, int data)
+{
+  setTX(id);
+  int checksum = ~((id + 5 + AX_WRITE_DATA + regstart + (data & 0xff) + ((data & 0xff00) >> 8)) % 256);
+  ax12write(0xFF);
+  ax12write(0xFF);
+  ax12write(id);
+  ax12write(5);
+  ax12write(AX_WRITE_DATA);
+  ax12write(regstart);
+  ax12write(data & 0xff);
+  ax12write((data & 0xff00) >> 8);
+  ax12write(checksum);
+  setRX(id);
+}
@@ -0,0 +1,49 @@
+//====================================================================
+// Host build - the parts of the Bioloid ax12 library used by
+// BioloidEX and Phoenix_Driver_AX12.  ax12.cpp runs them on the virtual
+// bus in AX12_Emulator.h.
+//====================================================================
+#ifndef _PHOENIX_HOST_AX12_H_
+#define _PHOENIX_HOST_AX12_H_
+#include <Arduino.h>
+
+#define AX12_MAX_SERVOS         30
+#define AX12_BUFFER_SIZE        32
+
+// EEPROM and RAM control table addresses
+#define AX_ID                   3
+#define AX_RETURN_DELAY_TIME    5
+#define AX_RETURN_LEVEL         16
+#define AX_TORQUE_ENABLE        24
+#define AX_LED                  25
+#define AX_GOAL_POSITION_L      30
+#define AX_GOAL_SPEED_L         32
+#define AX_PRESENT_POSITION_L   36
+#define AX_PRESENT_SPEED_L      38
+#define AX_PRESENT_LOAD_L       40
+#define AX_PRESENT_VOLTAGE      42
+#define AX_PRESENT_TEMPERATURE  43
+#define AX_MOVING               46
+
+// Instructions
+#define AX_PING                 1
+#define AX_READ_DATA            2
+#define AX_WRITE_DATA           3
+#define AX_SYNC_WRITE           131
+
+extern unsigned char ax_rx_buffer[AX12_BUFFER_SIZE];
+
+void ax12Init(long baud);
+void setTX(int id);
+void setRX(int id);
+void setTXall();
+void ax12write(unsigned char data);
+int ax12ReadPacket(int length);
+int ax12GetRegister(int id, int regstart, int length);
+void ax12SetRegister(int id, int regstart, int data);
+void ax12SetRegister2(int id, int regstart, int data);
+
+#define SetPosition(id, pos) (ax12SetRegister2(id, AX_GOAL_POSITION_L, pos))
+#define GetPosition(id) (ax12GetRegister(id, AX_PRESENT_POSITION_L, 2))
+#define Relax(id) (ax12SetRegister(id, AX_TORQUE_ENABLE, 0))
+#endif
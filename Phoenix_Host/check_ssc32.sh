@@ -0,0 +1,64 @@
+#!/bin/sh
+#====================================================================
+# Host build - checks the SSC-32 output of a few configurations against
+# the golden captures in Phoenix_Host/golden.
+#
+# Each configuration is built and run with the SSC-32 emulator for
+# 379 frames (the scripted input turns the robot off at 380).  Fails if:
+#   - any group move differs from the golden one in bytes, servos, T,
+#     start or wire time (golden/<cfg>.csv, from -f),
+#   - any group move is longer on the wire than the time since the
+#     previous one,
+#   - the summary or the final servo positions differ (golden/<cfg>.txt).
+#
+# Run from the directory holding the libraries:
+#   sh Phoenix_Host/check_ssc32.sh       - check
+#   sh Phoenix_Host/check_ssc32.sh -u    - update the golden captures,
+#                                          after a change meant to move them
+#====================================================================
+CFGS="THex_PS2_SSC32 THex4_PS2_SSC32 LSQuadA_PS2_SSC32 Chr3_Commander_SSC32"
+FRAMES=379
+GOLDEN=Phoenix_Host/golden
+TMP=${TMPDIR:-/tmp}/phoenix_check.$$
+fail=0
+
+mkdir -p $TMP $GOLDEN
+for cfg in $CFGS; do
+  if ! g++ -O2 -Wall -fpermissive -IPhoenix_Host -IPhoenix -IPhoenix_Driver_SSC32 \
+      -DHOST_CFG="\"$cfg/Hex_Cfg.h\"" Phoenix_Host/Phoenix_Host.cpp -o $TMP/phoenix 2> $TMP/$cfg.log; then
+    cat $TMP/$cfg.log
+    echo "$cfg: build failed"
+    fail=1
+    continue
+  fi
+  # The host (wall clock) time is the only part of the summary that changes between runs
+  $TMP/phoenix -n $FRAMES -e 1 -f $TMP/$cfg.csv 2>&1 > /dev/null | sed 's/, host [0-9.]* ms//' > $TMP/$cfg.txt
+
+  if [ "$1" = "-u" ]; then
+    cp $TMP/$cfg.csv $TMP/$cfg.txt $GOLDEN/
+    echo "$cfg: updated"
+    continue
+  fi
+
+  bad=0
+  # frame,bytes,servos,T_ms,start_us,wire_us,period_us; frame 0 has no period
+  over=`awk -F, 'NR > 2 && $6 > $7' $TMP/$cfg.csv | wc -l`
+  if [ $over -ne 0 ]; then
+    echo "$cfg: $over moves longer on the wire than their period"
+    bad=1
+  fi
+  for f in csv txt; do
+    if ! diff -u $GOLDEN/$cfg.$f $TMP/$cfg.$f > $TMP/$cfg.$f.diff; then
+      head -20 $TMP/$cfg.$f.diff
+      echo "$cfg: differs from $GOLDEN/$cfg.$f"
+      bad=1
+    fi
+  done
+  if [ $bad -eq 0 ]; then
+    echo "$cfg: ok"
+  else
+    fail=1
+  fi
+done
+rm -rf $TMP
+exit $fail
@@ -0,0 +1,4 @@
+//====================================================================
+// Host build - the pin macros live in Arduino.h.
+//====================================================================
+#include <Arduino.h>
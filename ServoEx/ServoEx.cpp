@@ -78,7 +78,7 @@
 cServoGroupMove ServoGroupMove;
 
 
-#define TRIM_DURATION       2                               // compensation ticks to trim adjust for digitalWrite delays // 12 August 2009
+#define TRIM_DURATION       2                               // compensation ticks to trim adjust for the ISR entry delay on the falling edge // 12 August 2009
 
 //#define NBR_TIMERS        (MAX_SERVOS / SERVOS_PER_TIMER)
 
@@ -109,7 +109,7 @@ static inline void handle_interrupts(timer16_Sequence_t timer, volatile uint16_t
   else{
 	pservo = &SERVO(timer,Channel[timer]);
     if( SERVO_INDEX(timer,Channel[timer]) < ServoCount && pservo->Pin.isActive == true )  {
-      digitalWrite( pservo->Pin.nbr,LOW); // pulse this channel low if activated   
+      *pservo->outReg &= ~pservo->bitMask; // pulse this channel low if activated   
 	  // See if we are in a timed move, if so update the move for the next time through...
 	  if (pservo->ticksDelta > 0) {
 	    pservo->ticks +=pservo->ticksDelta;
@@ -133,7 +133,7 @@ static inline void handle_interrupts(timer16_Sequence_t timer, volatile uint16_t
 	pservo = &SERVO(timer,Channel[timer]);
     *OCRnA = *TCNTn + pservo->ticks;
     if(pservo->Pin.isActive == true)     // check if activated
-      digitalWrite( pservo->Pin.nbr,HIGH); // its an active channel so pulse it high  
+      *pservo->outReg |= pservo->bitMask; // its an active channel so pulse it high  
 
   }  
   else { 
@@ -310,7 +310,13 @@ uint8_t ServoEx::attach(int pin, int min, int max)
 {
   if(this->servoIndex < MAX_SERVOS ) {
     pinMode( pin, OUTPUT) ;                                   // set servo pin to output
+    digitalWrite( pin, LOW);                                  // this also turns off any PWM on the pin, the ISR only touches the port
+    uint8_t oldSREG = SREG;
+    cli();
     servos[this->servoIndex].Pin.nbr = pin;  
+    servos[this->servoIndex].outReg = portOutputRegister(digitalPinToPort(pin));
+    servos[this->servoIndex].bitMask = digitalPinToBitMask(pin);
+    SREG = oldSREG;
     // todo min/max check: abs(min - MIN_PULSE_WIDTH) /4 < 128 
     this->min  = (MIN_PULSE_WIDTH - min)/4; //resolution of min/max is 4 uS
     this->max  = (MAX_PULSE_WIDTH - max)/4; 
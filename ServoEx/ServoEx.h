@@ -123,6 +123,8 @@ typedef struct  {
 
 typedef struct {
   ServoPin_t Pin;
+  volatile uint8_t *outReg;			  // Port output register of the pin, looked up once in attach
+  uint8_t bitMask;					  // and the pin's bit in it, so the ISR does not use digitalWrite
   unsigned int ticks;				  // Current Tick count 
   unsigned int ticksNew;			  // New end point tick count
   int	ticksDelta;					  // How much to change per servo cycle